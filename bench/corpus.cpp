@@ -0,0 +1,211 @@
+#include "corpus.hpp"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using std::string;
+using std::vector;
+
+using namespace cfg_parser;
+
+namespace cfg_parser_bench {
+
+namespace {
+
+// __Dyck-3, ambiguous through Dyck3 -> Dyck3 Dyck3__
+
+void build_dyck3(parser& pser) {
+    pser.create("Dyck3", { "" });
+    const auto dyck3 = pser.get_nont("Dyck3");
+    pser.insert("Dyck3", '(' + dyck3 + ')');
+    pser.insert("Dyck3", '[' + dyck3 + ']');
+    pser.insert("Dyck3", '{' + dyck3 + '}');
+    pser.insert("Dyck3", dyck3 + dyck3);
+}
+
+string generate_dyck3(size_t len, bool accepted) {
+    string word;
+    while (word.size() + 6 <= len) word += "([{}])";
+    while (word.size() + 2 <= len) word += "()";
+    if (word.empty()) word = "()";
+    if (!accepted) word.back() = '(';
+    return word;
+}
+
+// __Arithmetic expressions__
+
+void build_arith(parser& pser) {
+    pser.create("Expr");
+    pser.create("Term");
+    pser.create("Factor", { "x", "y", "z" });
+    const auto expr   = pser.get_nont("Expr");
+    const auto term   = pser.get_nont("Term");
+    const auto factor = pser.get_nont("Factor");
+
+    pser.insert("Expr", expr + '+' + term);
+    pser.insert("Expr", { term });
+    pser.insert("Term", term + '*' + factor);
+    pser.insert("Term", { factor });
+    pser.insert("Factor", '(' + expr + ')');
+}
+
+string generate_arith(size_t len, bool accepted) {
+    string word;
+    while (word.size() + 9 <= len) word += "x*(y+z)+";
+    while (word.size() + 3 <= len) word += "y+";
+    word += 'x';
+    if (!accepted) word.back() = '+';
+    return word;
+}
+
+// __JSON subset__
+
+void build_json(parser& pser) {
+    for (const auto name : {
+        "Value", "Object", "Members", "Pair", "Array",
+        "Elements", "String", "Chars", "Char", "Number", "Digit"
+    }) pser.create(name);
+
+    const auto value    = pser.get_nont("Value");
+    const auto object   = pser.get_nont("Object");
+    const auto members  = pser.get_nont("Members");
+    const auto pair     = pser.get_nont("Pair");
+    const auto array    = pser.get_nont("Array");
+    const auto elements = pser.get_nont("Elements");
+    const auto str      = pser.get_nont("String");
+    const auto chars    = pser.get_nont("Chars");
+    const auto ch       = pser.get_nont("Char");
+    const auto number   = pser.get_nont("Number");
+    const auto digit    = pser.get_nont("Digit");
+
+    for (const auto nont : { object, array, str, number }) {
+        pser.insert("Value", { nont });
+    }
+
+    pser.insert("Value", "true");
+    pser.insert("Value", "false");
+    pser.insert("Value", "null");
+
+    pser.insert("Object", "{}");
+    pser.insert("Object", '{' + members + '}');
+    pser.insert("Members", { pair });
+    pser.insert("Members", pair + ',' + members);
+    pser.insert("Pair", str + ':' + value);
+
+    pser.insert("Array", "[]");
+    pser.insert("Array", '[' + elements + ']');
+    pser.insert("Elements", { value });
+    pser.insert("Elements", value + ',' + elements);
+
+    pser.insert("String", '"' + chars + '"');
+    pser.insert("Chars", "");
+    pser.insert("Chars", ch + chars);
+    for (const char c : string("abcdef")) pser.insert("Char", prod_rule(1, c));
+
+    pser.insert("Number", { digit });
+    pser.insert("Number", digit + number);
+    for (const char c : string("0123456789")) pser.insert("Digit", prod_rule(1, c));
+}
+
+string generate_json(size_t len, bool accepted) {
+    const string elem = "{\"ab\":[12,\"cd\",true]}";
+    string word = "[";
+    while (true) {
+        const size_t sep = word.size() > 1;
+        if (word.size() + sep + elem.size() + 1 <= len) {
+            word += (sep ? "," : "") + elem;
+        } else if (word.size() + sep + 2 <= len) {
+            word += (sep ? ",7" : "7");
+        } else {
+            break;
+        }
+    }
+
+    if (word.size() == 1) word += '7';
+    word += accepted ? ']' : ',';
+    return word;
+}
+
+// __Palindromes over {a, b}, generated of even length__
+
+void build_pal(parser& pser) {
+    pser.create("Pal", { "", "a", "b" });
+    const auto pal = pser.get_nont("Pal");
+    pser.insert("Pal", 'a' + pal + 'a');
+    pser.insert("Pal", 'b' + pal + 'b');
+}
+
+string generate_pal(size_t len, bool accepted) {
+    string half;
+    for (size_t i = 0; i < std::max<size_t>(len / 2, 1); i++) {
+        half += i % 3 == 2 ? 'b' : 'a';
+    }
+
+    string word = half + string(half.rbegin(), half.rend());
+    if (!accepted) word[half.size() - 1] = word[half.size() - 1] == 'a' ? 'b' : 'a';
+    return word;
+}
+
+// __Expressions with 15 levels of precedence__
+
+const string prec_ops = "|^&=<>+-*/%!~?:"; // From the loosest to the tightest
+
+void build_prec(parser& pser) {
+    for (size_t i = 0; i <= prec_ops.size(); i++) pser.create("Prec" + std::to_string(i));
+    pser.insert("Prec" + std::to_string(prec_ops.size()), "x");
+    pser.insert("Prec" + std::to_string(prec_ops.size()), "y");
+
+    // Prec i -> Prec i op Prec i+1 | Prec i+1, and the tightest -> x | y | (Prec0)
+    for (size_t i = 0; i < prec_ops.size(); i++) {
+        const auto curr = pser.get_nont("Prec" + std::to_string(i));
+        const auto next = pser.get_nont("Prec" + std::to_string(i + 1));
+        pser.insert("Prec" + std::to_string(i), curr + prec_ops[i] + next);
+        pser.insert("Prec" + std::to_string(i), { next });
+    }
+
+    const auto prec0 = pser.get_nont("Prec0");
+    pser.insert("Prec" + std::to_string(prec_ops.size()), '(' + prec0 + ')');
+}
+
+string generate_prec(size_t len, bool accepted) {
+    string word = "x";
+    for (size_t i = 0; word.size() + 4 <= len; i++) {
+        word += prec_ops[i % prec_ops.size()];
+        word += "(y)";
+    }
+
+    if (!accepted) word += '(';
+    return word;
+}
+
+// __S -> SS | a__
+
+void build_ss(parser& pser) {
+    pser.create("S", { "a" });
+    const auto s = pser.get_nont("S");
+    pser.insert("S", s + s);
+}
+
+string generate_ss(size_t len, bool accepted) {
+    string word(std::max<size_t>(len, 1), 'a');
+    if (!accepted) word.back() = 'b';
+    return word;
+}
+
+} // End of anonymous namespace
+
+const vector<corpus_entry>& corpus() {
+    static const vector<corpus_entry> entries = {
+        { "dyck3",  "Dyck3", true,  build_dyck3, generate_dyck3 },
+        { "arith",  "Expr",  false, build_arith, generate_arith },
+        { "json",   "Value", false, build_json,  generate_json  },
+        { "pal",    "Pal",   false, build_pal,   generate_pal   },
+        { "prec15", "Prec0", false, build_prec,  generate_prec  },
+        { "s_ss_a", "S",     true,  build_ss,    generate_ss    },
+    };
+
+    return entries;
+}
+
+} // End of namespace cfg_parser_bench
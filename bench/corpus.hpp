@@ -0,0 +1,24 @@
+#pragma once
+
+#include "cfg_parser.hpp"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace cfg_parser_bench {
+
+/* A grammar built through the public parser API, together with
+a generator of accepted and rejected words of about a given length */
+struct corpus_entry {
+    std::string name;
+    std::string start; // Name of the grammar to parse against
+    bool ambiguous;    // Whether every engine is cubic on it
+
+    std::function<void(cfg_parser::parser&)> build;
+    std::function<std::string(size_t len, bool accepted)> generate;
+};
+
+const std::vector<corpus_entry>& corpus();
+
+} // End of namespace cfg_parser_bench
@@ -0,0 +1,339 @@
+#include "corpus.hpp"
+#include "cfg_parser.hpp"
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <cstdio>
+
+using std::string;
+using std::vector;
+
+using namespace cfg_parser;
+using namespace cfg_parser_bench;
+
+namespace {
+
+struct engine_entry { const char* name; parse_engine engine; };
+
+const engine_entry engines[] = {
+    { "top_down", parse_engine::top_down },
+    { "cyk",      parse_engine::cyk      },
+    { "earley",   parse_engine::earley   },
+};
+
+constexpr size_t min_len   = 10;
+constexpr size_t max_len   = 10000;
+constexpr size_t cubic_len = 1000; // Longest input for engines that are cubic on it
+
+size_t longest_input(const corpus_entry& entry, parse_engine engine) {
+    if (entry.ambiguous || engine != parse_engine::earley) return cubic_len;
+    return max_len;
+}
+
+// Time to normalize and compile a freshly built grammar
+void normalize(benchmark::State& state, const corpus_entry& entry) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto pser = std::make_unique<parser>();
+        entry.build(*pser);
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(pser->compile(entry.start));
+
+        state.PauseTiming();
+        pser.reset();
+        state.ResumeTiming();
+    }
+}
+
+// Latency of the first parse on a freshly built grammar, normalization included
+void first_parse(benchmark::State& state, const corpus_entry& entry, parse_engine engine) {
+    const string word = entry.generate(state.range(0), state.range(1));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto pser = std::make_unique<parser>();
+        entry.build(*pser);
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(pser->parse(entry.start, word, engine));
+
+        state.PauseTiming();
+        pser.reset();
+        state.ResumeTiming();
+    }
+}
+
+// Latency of a parse against an already compiled grammar
+void warm_parse(benchmark::State& state, const corpus_entry& entry, parse_engine engine) {
+    parser pser;
+    entry.build(pser);
+    const auto compiled = pser.compile(entry.start);
+    const string word = entry.generate(state.range(0), state.range(1));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(compiled->parse(word, engine));
+    }
+
+    state.SetBytesProcessed(state.iterations() * word.size());
+}
+
+// Words per second over a batch of short accepted and rejected words
+void batch_throughput(benchmark::State& state, const corpus_entry& entry, parse_engine engine) {
+    parser pser;
+    entry.build(pser);
+    const auto compiled = pser.compile(entry.start);
+
+    vector<string> words;
+    for (size_t i = 0; i < 1000; i++) {
+        words.push_back(entry.generate(min_len + i % 40, i % 2));
+    }
+
+    for (auto _ : state) {
+        for (const auto& word : words) {
+            benchmark::DoNotOptimize(compiled->parse(word, engine));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * words.size());
+}
+
+// Words per second through parser::parse_batch, with state.range(0) threads
+void parallel_batch_throughput(benchmark::State& state, const corpus_entry& entry, parse_engine engine) {
+    parser pser;
+    entry.build(pser);
+    pser.set_num_threads(state.range(0));
+
+    vector<string> texts;
+    for (size_t i = 0; i < 20000; i++) {
+        texts.push_back(entry.generate(min_len + i % 40, i % 2));
+    }
+
+    const vector<std::string_view> words(texts.begin(), texts.end());
+    benchmark::DoNotOptimize(pser.parse_batch(entry.start, words, engine)); // Compiles the grammar
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pser.parse_batch(entry.start, words, engine));
+    }
+
+    state.SetItemsProcessed(state.iterations() * words.size());
+}
+
+/* Time for an insert and an erase of one rule deep inside a compiled grammar
+of about 3 * state.range(0) rules, recompiling it after each edit or not.
+Edits alone only drop the snapshot, leaving the next compile to rebuild it. */
+void edit(benchmark::State& state, bool recompile) {
+    // Node i -> Node 2i+1 Node 2i+2 | Node 2i+1 + Node 2i+2 | x, leaves -> a | b | ab
+    const size_t num_nodes = state.range(0);
+    parser pser;
+    for (size_t i = 0; i < num_nodes; i++) pser.create("N" + std::to_string(i));
+    for (size_t i = 0; i < num_nodes; i++) {
+        const string name = "N" + std::to_string(i);
+        if (2 * i + 2 >= num_nodes) {
+            for (const auto rule : { "a", "b", "ab" }) pser.insert(name, rule);
+            continue;
+        }
+
+        const auto left  = pser.get_nont("N" + std::to_string(2 * i + 1));
+        const auto right = pser.get_nont("N" + std::to_string(2 * i + 2));
+        pser.insert(name, left + right);
+        pser.insert(name, left + '+' + right);
+        pser.insert(name, "x");
+    }
+
+    pser.compile("N0");
+    const string leaf = "N" + std::to_string((num_nodes - 3) / 2 * 2 + 2); // Child of the last inner node
+    for (auto _ : state) {
+        pser.insert(leaf, "c");
+        if (recompile) pser.compile("N0");
+        pser.erase(leaf, "c");
+        if (recompile) pser.compile("N0");
+    }
+}
+
+/* Time to compile state.range(0) grammars, Stmt i -> i Value, all
+reaching the same Value of the JSON grammar from the corpus */
+void many_grammars(benchmark::State& state, const corpus_entry& entry) {
+    const size_t num_grams = state.range(0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto pser = std::make_unique<parser>();
+        entry.build(*pser);
+        const auto start = pser->get_nont(entry.start);
+        for (size_t i = 0; i < num_grams; i++) {
+            pser->create("Stmt" + std::to_string(i), { std::to_string(i) + start });
+        }
+
+        state.ResumeTiming();
+
+        for (size_t i = 0; i < num_grams; i++) {
+            benchmark::DoNotOptimize(pser->compile("Stmt" + std::to_string(i)));
+        }
+
+        state.PauseTiming();
+        pser.reset();
+        state.ResumeTiming();
+    }
+}
+
+/* Time to load an EBNF source of state.range(0) lines, a rule every 4 lines
+with an alternative on each of the others, referring forward to later rules */
+void load(benchmark::State& state) {
+    const size_t num_rules = state.range(0) / 4;
+    const auto name = [](size_t i) { return "Rule" + std::to_string(i); };
+
+    string source;
+    for (size_t i = 0; i < num_rules; i++) {
+        source += name(i) + " ::=  # Rule " + std::to_string(i) + "\n";
+        source += "    'a' " + name((i + 1) % num_rules) + " 'b'\n";
+        source += "  | \"cd\" " + name((i * 7 + 3) % num_rules) + " [ ',' " + name(i / 2) + " ]\n";
+        source += "  | { 'e' } 'x' ;\n";
+    }
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto pser = std::make_unique<parser>();
+        state.ResumeTiming();
+
+        pser->load_source(source);
+
+        state.PauseTiming();
+        pser.reset();
+        state.ResumeTiming();
+    }
+
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+/* Lines per second through parser::parse_file of a file of 20000 lines,
+writing text to a sink that drops it if state.range(0) is 0, else a result file */
+void parse_file(benchmark::State& state, const corpus_entry& entry) {
+    parser pser;
+    entry.build(pser);
+
+    const string dir = std::filesystem::temp_directory_path().string() + '/';
+    const string file_name   = dir + "cfg_parser_bench_lines.txt";
+    const string result_name = dir + "cfg_parser_bench_lines.bits";
+
+    constexpr size_t num_lines = 20000;
+    {
+        std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+        for (size_t i = 0; i < num_lines; i++) out << entry.generate(min_len + i % 40, i % 2) << '\n';
+    }
+
+    pser.compile(entry.start);
+    for (auto _ : state) {
+        if (state.range(0)) {
+            benchmark::DoNotOptimize(pser.parse_file_to(entry.start, file_name, result_name));
+        } else {
+            size_t written = 0;
+            pser.parse_file(entry.start, file_name, [&](std::string_view chunk) { written += chunk.size(); });
+            benchmark::DoNotOptimize(written);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_lines);
+    std::remove(file_name.c_str());
+    std::remove(result_name.c_str());
+}
+
+void register_benchmarks() {
+    for (const bool recompile : { false, true }) {
+        benchmark::RegisterBenchmark(recompile ? "edit_and_compile" : "edit", edit, recompile)
+            ->RangeMultiplier(4)
+            ->Range(1 << 8, 1 << 14)
+            ->ArgName("nodes")
+            ->Unit(benchmark::kMillisecond);
+    }
+
+    benchmark::RegisterBenchmark("load", load)
+        ->RangeMultiplier(10)
+        ->Range(400, 40000)
+        ->ArgName("lines")
+        ->Unit(benchmark::kMillisecond);
+
+    const auto json = std::find_if(
+        corpus().begin(), corpus().end(),
+        [](const corpus_entry& entry) { return entry.name == "json"; }
+    );
+
+    benchmark::RegisterBenchmark("parse_file/json", parse_file, *json)
+        ->Arg(0)
+        ->Arg(1)
+        ->ArgName("to_result_file")
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+    benchmark::RegisterBenchmark("many_grammars/json", many_grammars, *json)
+        ->RangeMultiplier(4)
+        ->Range(16, 1024)
+        ->ArgName("grammars")
+        ->Unit(benchmark::kMillisecond);
+
+    for (const auto& entry : corpus()) {
+        benchmark::RegisterBenchmark(("normalize/" + entry.name).c_str(), normalize, entry)
+            ->Unit(benchmark::kMicrosecond);
+
+        for (const auto& [engine_name, engine] : engines) {
+            const string suffix = entry.name + '/' + engine_name;
+
+            benchmark::RegisterBenchmark(("first_parse/" + suffix).c_str(), first_parse, entry, engine)
+                ->ArgsProduct({ { 100 }, { 1, 0 } })
+                ->ArgNames({ "len", "accepted" })
+                ->Unit(benchmark::kMicrosecond);
+
+            auto* warm = benchmark::RegisterBenchmark(("warm_parse/" + suffix).c_str(), warm_parse, entry, engine)
+                ->ArgNames({ "len", "accepted" })
+                ->Unit(benchmark::kMicrosecond);
+
+            for (size_t len = min_len; len <= longest_input(entry, engine); len *= 10) {
+                warm->Args({ static_cast<int64_t>(len), 1 });
+                warm->Args({ static_cast<int64_t>(len), 0 });
+            }
+
+            benchmark::RegisterBenchmark(("batch_throughput/" + suffix).c_str(), batch_throughput, entry, engine)
+                ->Unit(benchmark::kMillisecond);
+
+            benchmark::RegisterBenchmark(("parallel_batch_throughput/" + suffix).c_str(), parallel_batch_throughput, entry, engine)
+                ->RangeMultiplier(2)
+                ->Range(1, std::max<unsigned>(std::thread::hardware_concurrency(), 1))
+                ->ArgName("threads")
+                ->UseRealTime()
+                ->Unit(benchmark::kMillisecond);
+        }
+    }
+}
+
+} // End of anonymous namespace
+
+/* Results are written as JSON to cfg_parser_bench.json
+unless --benchmark_out is given on the command line */
+int main(int argc, char** argv) {
+    vector<char*> args(argv, argv + argc);
+    bool has_out = false;
+    for (const std::string_view arg : args) {
+        has_out |= arg.rfind("--benchmark_out=", 0) == 0;
+    }
+
+    string out_arg    = "--benchmark_out=cfg_parser_bench.json";
+    string format_arg = "--benchmark_out_format=json";
+    if (!has_out) {
+        args.push_back(out_arg.data());
+        args.push_back(format_arg.data());
+    }
+
+    int num_args = static_cast<int>(args.size());
+    benchmark::Initialize(&num_args, args.data());
+    if (benchmark::ReportUnrecognizedArguments(num_args, args.data())) return 1;
+
+    register_benchmarks();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,12 +1,23 @@
 #pragma once
 
 #include "grammar.hpp"
+#include "compiled_grammar.hpp"
 
 #include <memory>
 #include <utility>
+#include <vector>
+#include <string_view>
+#include <future>
+#include <functional>
 
 namespace cfg_parser {
 
+// How rules longer than 2 symbols are split into pairs while normalizing
+enum class binarization {
+    prefix_sharing, // Left to right, so rules sharing a prefix share its pairs
+    smallest        // At the points reusing the most pairs, adding the fewest new ones
+};
+
 class parser {
 
 public:
@@ -15,9 +26,32 @@ public:
 
     void create(const std::string& name);
     void create(const std::string& name, std::initializer_list<prod_rule>);
+
+    /* Reads grammars written in EBNF, such as
+
+        # Comments run to the end of the line
+        Expr   ::= Expr '+' Term | Term ;
+        Term   ::= 'x' | '(' Expr ')' | <Call>
+        <Call> ::= "f(" [ Expr { ',' Expr } ] ')'
+
+    Names are identifiers or anything between angle brackets, terminals are
+    quoted, and rules end with ';' or where the next one starts. { } repeats,
+    [ ] is optional and ( ) groups, as do the postfix *, + and ?, each through
+    a helper grammar named after the rule (Expr#1, Expr#2...). Names may be
+    used before they're defined, and grammars that exist already get the
+    rules added. On error, nothing is changed and std::invalid_argument names
+    the line. Like create, it must not run alongside any other call. */
+    void load(const std::string& file_name);
+    void load_source(std::string_view source);
     
     nonterminal get_nont(const std::string& name);
 
+    /* insert and erase may run while other threads parse. Those parses keep
+    the snapshot they started with, and every compiled grammar that can reach
+    the edited one is dropped before the edit returns, so the next parse or
+    compile builds the current version. With background compilation, the
+    next version is swapped in soon after instead.
+    create must not run alongside any other call. */
     bool insert(const std::string& name, const prod_rule&);
     bool insert(const std::string& name, prod_rule&&);
     bool erase(const std::string& name, const prod_rule&);
@@ -25,12 +59,63 @@ public:
     void print(const std::string& name);
     void print_norm(const std::string& name);
 
-    bool parse(const std::string& name, const std::string& word);
-    void parse_file(const std::string& name, const std::string& file_name);
+    // Normalizes and flattens the grammar, as it is now, into a standalone snapshot
+    std::shared_ptr<const compiled_grammar> compile(const std::string& name);
+
+    /* Same as compile, but on a background thread, so the first parse of a
+    grammar needn't pay for it. The future rethrows what compile would throw. */
+    std::future<std::shared_ptr<const compiled_grammar>> compile_async(const std::string& name);
+
+    bool parse(const std::string& name, const std::string& word, parse_engine = parse_engine::cyk);
+
+    // Element i of the result is whether the grammar accepts words[i]
+    std::vector<bool> parse_batch(
+        const std::string& name,
+        const std::vector<std::string_view>& words,
+        parse_engine = parse_engine::cyk
+    );
+
+    /* Parses every line of the file, without its line break, in parallel
+    like parse_batch and with a single snapshot of the grammar. The file is
+    mapped rather than read, so it may be far larger than memory. The first
+    writes "<name> accepts <line>" or "<name> rejects <line>" for each line
+    to std::cout, the second hands the same text to sink in large chunks,
+    in order. Both throw std::invalid_argument if the file can't be read. */
+    void parse_file(
+        const std::string& name, const std::string& file_name, parse_engine = parse_engine::cyk
+    );
+    void parse_file(
+        const std::string& name, const std::string& file_name,
+        const std::function<void(std::string_view)>& sink, parse_engine = parse_engine::cyk
+    );
+
+    /* Same, but writes a compact result file instead: the number of lines as
+    a little-endian 64-bit integer, then a bit per line, set if it's accepted,
+    lowest bit first. Returns the number of lines. */
+    size_t parse_file_to(
+        const std::string& name, const std::string& file_name, const std::string& result_file_name,
+        parse_engine = parse_engine::cyk
+    );
+
+    /* Threads used by parse_batch, where 0 (the default) means one per hardware
+    thread. Batches already running when it's called finish on the old threads. */
+    void set_num_threads(size_t num_threads);
+
+    // Applies to the rules normalized from then on, prefix_sharing by default
+    void set_binarization(binarization);
+
+    /* Off by default. Once on, edits return without recompiling the grammars
+    they affect, which are recompiled on a background thread instead. Parses
+    meanwhile keep using the previous snapshot, while compile waits for the
+    current one. Grammars never compiled are still compiled by their first
+    parse, unless compile_async has warmed them up. */
+    void set_background_compile(bool);
 
 private:
     class impl;
     std::unique_ptr<impl> pimpl;
+
+    friend class compiled_grammar;
 };
 
 } // End of namespace cfg_parser
\ No newline at end of file
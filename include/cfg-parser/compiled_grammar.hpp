@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+
+namespace cfg_parser {
+
+class grammar;
+class nonterminal;
+
+enum class parse_engine {
+    top_down, // Memoized recursive descent over the normalized form
+    cyk,      // Bottom-up bit-parallel CYK over the normalized form
+    earley    // Earley over the grammar as written, skipping normalization
+};
+
+/* An immutable snapshot of a grammar and its normalized form,
+flattened into contiguous integer tables. Obtained from
+parser::compile and unaffected by later edits to the parser. */
+class compiled_grammar {
+
+public:
+    compiled_grammar(const compiled_grammar&) = delete;
+    compiled_grammar(compiled_grammar&&)      = delete;
+   ~compiled_grammar();
+
+    compiled_grammar& operator=(const compiled_grammar&) = delete;
+    compiled_grammar& operator=(compiled_grammar&&)      = delete;
+
+    // __Capacity__
+
+    size_t num_nonterminals() const; // of the normalized form
+    size_t num_rules() const;        // of the normalized form
+
+    // Nonts of the normalized form merged into an equivalent one, which num_nonterminals leaves out
+    size_t num_merged_nonterminals() const;
+
+    // Nonts of the normalized form deriving no word, and rules mentioning them, pruned from it
+    size_t num_pruned_nonterminals() const;
+    size_t num_pruned_rules() const;
+
+    // Number of edits made to the parser before this snapshot was taken
+    std::uint64_t version() const;
+
+    // Name of the grammar it was compiled from
+    std::string_view name() const;
+
+    // __Parsing__
+
+    bool parse(const std::string& word, parse_engine = parse_engine::cyk) const;
+
+    // __Serialization__
+
+    /* Writes the snapshot in a versioned binary format free of pointers, the
+    same tables it parses with. Only the build that saved it loads it back. */
+    void save(const std::string& file_name) const;
+
+    /* Maps the file in place rather than reading it, so loading takes no pass
+    over the tables. The file must not change while the snapshot is alive.
+    Throws std::invalid_argument for files that aren't compiled grammars. */
+    static std::shared_ptr<const compiled_grammar> load(const std::string& file_name);
+
+private:
+    class impl;
+
+    // Compiles only the grammar as written, enough for parse_engine::earley
+    compiled_grammar(
+        const grammar& gram, const std::unordered_map<nonterminal, std::string>& names, std::uint64_t version
+    );
+
+    // norm_form must be the normalized form of gram, with the given number of nonts and rules pruned
+    compiled_grammar(
+        const grammar& gram, const grammar& norm_form,
+        const std::unordered_map<nonterminal, std::string>& names, std::uint64_t version,
+        size_t num_pruned_nonts, size_t num_pruned_rules
+    );
+
+    explicit compiled_grammar(std::unique_ptr<const impl>);
+
+    std::unique_ptr<const impl> pimpl;
+
+    friend class parser;
+};
+
+} // End of namespace cfg_parser
@@ -4,8 +4,13 @@
 
 #include <initializer_list>
 #include <unordered_set>
+#include <unordered_map>
 #include <utility>
 #include <memory>
+#include <atomic>
+#include <iterator>
+#include <cstdint>
+#include <cstddef>
 
 namespace cfg_parser {
 
@@ -37,8 +42,9 @@ public:
 
     // __Iterators__
 
-    using iterator       = std::unordered_set<prod_rule>::iterator;
-    using const_iterator = std::unordered_set<prod_rule>::const_iterator;
+    // Rules can't be changed in place, as grammars holding equal ones share them
+    class const_iterator;
+    using iterator = const_iterator;
 
     iterator begin();
     iterator   end();
@@ -98,8 +104,62 @@ private:
     template <typename nont_visitor>
     class traverser;
     
+    class rule_set;
+    class rule_pool;
     class impl;
     std::unique_ptr<impl> pimpl;
+
+    /* Every distinct rule held by some grammar, stored once and by id in
+    chunks that never move, so reading one takes no lock */
+    static constexpr size_t pool_chunk_bits = 12;
+    static constexpr size_t pool_max_chunks = size_t(1) << (28 - pool_chunk_bits);
+    static std::atomic<const prod_rule*> pool_chunks[pool_max_chunks];
+
+    static const prod_rule& interned(std::uint32_t id) {
+        const auto chunk = pool_chunks[id >> pool_chunk_bits].load(std::memory_order_acquire);
+        return chunk[id & ((std::uint32_t(1) << pool_chunk_bits) - 1)];
+    }
+
+    friend class symbol; // for the id it holds
+};
+
+// Walks the ids of the rules, contiguous in the grammar, reading each from the pool
+class grammar::const_iterator {
+
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type        = prod_rule;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const prod_rule*;
+    using reference         = const prod_rule&;
+
+    const_iterator() = default;
+    explicit const_iterator(const std::uint32_t* pos) : pos(pos) {}
+
+    reference operator*()  const { return  interned(*pos); }
+    pointer   operator->() const { return &interned(*pos); }
+    reference operator[](difference_type n) const { return interned(pos[n]); }
+
+    const_iterator& operator++() { ++pos; return *this; }
+    const_iterator& operator--() { --pos; return *this; }
+    const_iterator  operator++(int) { return const_iterator(pos++); }
+    const_iterator  operator--(int) { return const_iterator(pos--); }
+
+    const_iterator& operator+=(difference_type n) { pos += n; return *this; }
+    const_iterator& operator-=(difference_type n) { pos -= n; return *this; }
+    const_iterator  operator+ (difference_type n) const { return const_iterator(pos + n); }
+    const_iterator  operator- (difference_type n) const { return const_iterator(pos - n); }
+    difference_type operator- (const_iterator other) const { return pos - other.pos; }
+
+    friend bool operator==(const_iterator lhs, const_iterator rhs) { return lhs.pos == rhs.pos; }
+    friend bool operator!=(const_iterator lhs, const_iterator rhs) { return lhs.pos != rhs.pos; }
+    friend bool operator< (const_iterator lhs, const_iterator rhs) { return lhs.pos <  rhs.pos; }
+    friend bool operator> (const_iterator lhs, const_iterator rhs) { return lhs.pos >  rhs.pos; }
+    friend bool operator<=(const_iterator lhs, const_iterator rhs) { return lhs.pos <= rhs.pos; }
+    friend bool operator>=(const_iterator lhs, const_iterator rhs) { return lhs.pos >= rhs.pos; }
+
+private:
+    const std::uint32_t* pos = nullptr;
 };
 
 // __Nonmember Functions of grammar__
@@ -4,88 +4,135 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <new>
+#include <cstdint>
 
 namespace cfg_parser {
 
+/* Rules of up to inline_capacity symbols, as most normalized ones are,
+keep them inline, so copying or building one allocates nothing. Longer
+rules move their symbols to the heap. */
 class prod_rule {
 
 public:
     // __Special Member Functions__
 
-    prod_rule() = default;
-    prod_rule(std::initializer_list<symbol> init) : symbols(init) {}
-    prod_rule(const std::string& term_seq)        : symbols(term_seq.begin(), term_seq.end()) {}
+    prod_rule() {}
+    prod_rule(std::initializer_list<symbol> init) { append(init.begin(), init.end()); }
+    prod_rule(const std::string& term_seq)        { append(term_seq.begin(), term_seq.end()); }
     prod_rule(const char term_seq[]);
 
     template <typename input_it>
-    prod_rule(input_it beg, input_it end) : symbols(beg, end) {}
+    prod_rule(input_it beg, input_it end) { append(beg, end); }
 
     template <typename symb_arg>
-    explicit prod_rule(size_t count, const symb_arg& arg) : symbols(count, arg) {}
+    explicit prod_rule(size_t count, const symb_arg& arg) { append(count, arg); }
+
+    prod_rule(const prod_rule&);
+    prod_rule(prod_rule&&) noexcept;
+   ~prod_rule() { if (on_heap()) ::operator delete(heap); }
+
+    prod_rule& operator=(const prod_rule&);
+    prod_rule& operator=(prod_rule&&) noexcept;
 
     template <typename input_it>
-    prod_rule& assign(input_it beg, input_it end) { symbols.assign(beg, end); return *this; }
+    prod_rule& assign(input_it beg, input_it end) { len = 0; append(beg, end); return *this; }
 
     template <typename symb_arg>
-    prod_rule& assign(size_t count, const symb_arg& arg) { symbols.assign(count, arg); return *this; }
+    prod_rule& assign(size_t count, const symb_arg& arg) { len = 0; append(count, arg); return *this; }
 
     template <typename symb_arg>
-    prod_rule& operator=(const symb_arg& arg)                { symbols.assign(1, arg); return *this; }
-    prod_rule& operator=(std::initializer_list<symbol> init) { symbols = init; return *this; }
-    prod_rule& operator=(const std::string& term_seq)        { symbols.assign(term_seq.begin(), term_seq.end()); return *this; }
+    prod_rule& operator=(const symb_arg& arg)                { return assign(1, arg); }
+    prod_rule& operator=(std::initializer_list<symbol> init) { return assign(init.begin(), init.end()); }
+    prod_rule& operator=(const std::string& term_seq)        { return assign(term_seq.begin(), term_seq.end()); }
     prod_rule& operator=(const char term_seq[]);
 
     // __Iterators__
 
-    using iterator       = std::vector<symbol>::iterator;
-    using const_iterator = std::vector<symbol>::const_iterator;
+    using iterator       = symbol*;
+    using const_iterator = const symbol*;
 
-    iterator begin()             { return symbols.begin(); }
-    iterator   end()             { return symbols.end();   }
+    iterator begin()             { return data(); }
+    iterator   end()             { return data() + len; }
 
-    const_iterator begin() const { return symbols.begin(); }
-    const_iterator   end() const { return symbols.end();   }
+    const_iterator begin() const { return data(); }
+    const_iterator   end() const { return data() + len; }
 
-    symbol& front()              { return symbols.front(); }
-    symbol&  back()              { return symbols.back();  }
+    symbol& front()              { return data()[0]; }
+    symbol&  back()              { return data()[len - 1]; }
 
-    const symbol& front() const  { return symbols.front(); }
-    const symbol&  back() const  { return symbols.back();  }
+    const symbol& front() const  { return data()[0]; }
+    const symbol&  back() const  { return data()[len - 1]; }
  
     // __Accessors__
 
-    symbol& at(size_t index)                     { return symbols.at(index); }
-    symbol& operator[](size_t index)             { return symbols.at(index); }
+    symbol& at(size_t index)                     { return data()[checked(index)]; }
+    symbol& operator[](size_t index)             { return data()[checked(index)]; }
 
-    const symbol& at(size_t index) const         { return symbols.at(index); }
-    const symbol& operator[](size_t index) const { return symbols.at(index); }
+    const symbol& at(size_t index) const         { return data()[checked(index)]; }
+    const symbol& operator[](size_t index) const { return data()[checked(index)]; }
 
     // __Capcity__
 
-    size_t   size() const { return symbols.size();  }
-    bool is_empty() const { return symbols.empty(); }
+    size_t   size() const { return len; }
+    bool is_empty() const { return len == 0; }
     bool is_unit () const { return size() == 1 && front().is_nont(); }
     bool contains(const symbol&) const;
 
+    static constexpr size_t inline_capacity = 4;
+
     // __Modifiers__
 
-    iterator erase(iterator pos)       { return symbols.erase(pos); }
-    iterator erase(const_iterator pos) { return symbols.erase(pos); }
+    iterator erase(const_iterator pos);
 
     template <typename symb_pred>
     size_t prune_if(symb_pred&&);
     size_t prune(const symbol&);
 
     template <typename symb_arg>
-    prod_rule& operator+=(const symb_arg& arg)  /* Append */  { symbols.emplace_back(arg);   return *this; }
-    prod_rule& operator+=(const prod_rule& other)             { symbols.insert(end(), other.begin(), other.end()); return *this; }
-    prod_rule& operator+=(std::initializer_list<symbol> init) { symbols.insert(end(), init.begin(), init.end()); return *this; }
-    prod_rule& operator+=(const std::string& term_seq)        { symbols.insert(end(), term_seq.begin(), term_seq.end()); return *this; }
+    prod_rule& operator+=(const symb_arg& arg)  /* Append */  { push_back(symbol(arg)); return *this; }
+    prod_rule& operator+=(const prod_rule& other);
+    prod_rule& operator+=(std::initializer_list<symbol> init) { append(init.begin(), init.end()); return *this; }
+    prod_rule& operator+=(const std::string& term_seq)        { append(term_seq.begin(), term_seq.end()); return *this; }
     prod_rule& operator+=(const char term_seq[]);
 
 private:
-    std::vector<symbol> symbols;
+    std::uint32_t len = 0;
+    std::uint32_t cap = inline_capacity;
+    union {
+        symbol* heap = nullptr;
+        symbol  local[inline_capacity];
+    };
+
+    bool on_heap() const { return cap > inline_capacity; }
+
+    symbol*       data()       { return on_heap() ? heap : local; }
+    const symbol* data() const { return on_heap() ? heap : local; }
+
+    // Throws std::out_of_range like std::vector::at
+    size_t checked(size_t index) const;
+
+    void reserve(size_t new_cap) { if (new_cap > cap) grow(new_cap); }
+    void grow(size_t new_cap);
+
+    void push_back(symbol symb) {
+        if (len == cap) grow(2 * size_t(cap));
+        new (data() + len++) symbol(symb);
+    }
+
+    template <typename input_it>
+    void append(input_it beg, input_it end);
+
+    template <typename symb_arg>
+    void append(size_t count, const symb_arg& arg) {
+        reserve(len + count);
+        const symbol symb(arg);
+        for (size_t i = 0; i < count; i++) new (data() + len++) symbol(symb);
+    }
 
     friend bool operator==(const prod_rule&, const prod_rule&);
 
@@ -110,7 +157,9 @@ inline prod_rule operator+(char ch, prod_rule&  rule) { return prod_rule(1, ch)
 inline prod_rule operator+(char ch,    terminal term) { return prod_rule(1, ch) += term; }
 inline prod_rule operator+(char ch, nonterminal nont) { return prod_rule(1, ch) += nont; }
 
-inline bool operator==(const prod_rule& lhs, const prod_rule& rhs) { return lhs.symbols == rhs.symbols; }
+inline bool operator==(const prod_rule& lhs, const prod_rule& rhs) {
+    return lhs.len == rhs.len && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
 inline bool operator!=(const prod_rule& lhs, const prod_rule& rhs) { return !(lhs == rhs); }
 
 } // End of namespace cfg_parser
@@ -124,10 +173,18 @@ namespace std {
 
 // __Implementation Details__
 
+template <typename input_it>
+void cfg_parser::prod_rule::append(input_it beg, input_it end) {
+    using category = typename std::iterator_traits<input_it>::iterator_category;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>)
+        reserve(len + std::distance(beg, end));
+
+    for (; beg != end; ++beg) push_back(symbol(*beg));
+}
+
 template <typename symb_pred>
 size_t cfg_parser::prod_rule::prune_if(symb_pred&& pred) {
-    size_t old_size = size();
-    const auto new_end = std::remove_if(begin(), end(), pred);
-    symbols.erase(new_end, end());
+    const size_t old_size = size();
+    len = static_cast<std::uint32_t>(std::remove_if(begin(), end(), pred) - begin());
     return old_size - size();
 }
\ No newline at end of file
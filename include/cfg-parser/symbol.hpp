@@ -1,8 +1,10 @@
 #pragma once
 
-#include <variant>
 #include <iostream>
 #include <stdexcept>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
 
 namespace cfg_parser {
 
@@ -49,37 +51,61 @@ private:
 inline bool operator==(nonterminal lhs, nonterminal rhs) { return lhs.ptr == rhs.ptr; }
 inline bool operator!=(nonterminal lhs, nonterminal rhs) { return !(lhs == rhs); }
 
+/* A terminal or a nonterminal in 32 bits: terminals are term_flag | their
+char, nonterminals the dense id their grammar holds for as long as it
+lives. Comparing and hashing symbols never has to look the grammar up. */
 class symbol {
 
 public:
-    symbol(char term)        : container(term) {}
-    symbol(terminal term)    : container(term) {}
-    symbol(nonterminal nont) : container(nont) {}
+    symbol(char term)        : symbol(terminal(term)) {}
+    symbol(terminal term)    : code(term_flag | static_cast<unsigned char>(term.get())) {}
+    symbol(nonterminal nont) : code(id_of(*nont)) {}
 
-    symbol& operator=(char term)        { container = term; return *this; }
-    symbol& operator=(terminal term)    { container = term; return *this; }
-    symbol& operator=(nonterminal nont) { container = nont; return *this; }
+    symbol& operator=(char term)        { return *this = symbol(term); }
+    symbol& operator=(terminal term)    { return *this = symbol(term); }
+    symbol& operator=(nonterminal nont) { return *this = symbol(nont); }
 
-    bool is_term()    const { return std::holds_alternative<   terminal>(container); }
-    bool is_nont() const { return std::holds_alternative<nonterminal>(container); }
+    bool is_term() const { return  (code & term_flag); }
+    bool is_nont() const { return !(code & term_flag); }
 
-    terminal&    as_term()             { return std::get<   terminal>(container); }
-    nonterminal& as_nont()             { return std::get<nonterminal>(container); }
+    // Both throw std::logic_error if the symbol holds the other kind
+    terminal as_term() const {
+        if (!is_term()) throw std::logic_error("Symbol isn't a terminal.");
+        return terminal(static_cast<char>(code & ~term_flag));
+    }
 
-    const terminal&    as_term() const { return std::get<   terminal>(container); }
-    const nonterminal& as_nont() const { return std::get<nonterminal>(container); }
+    nonterminal as_nont() const {
+        if (!is_nont()) throw std::logic_error("Symbol isn't a nonterminal.");
+        return nonterminal(grammar_of(code));
+    }
 
-    friend bool operator==(const symbol&, const symbol&);
+    friend bool operator==(symbol lhs, symbol rhs) { return lhs.code == rhs.code; }
+    friend bool operator!=(symbol lhs, symbol rhs) { return lhs.code != rhs.code; }
     friend struct std::hash<symbol>;
 
 private:
-    std::variant<terminal, nonterminal> container;
+    static constexpr std::uint32_t term_flag = std::uint32_t(1) << 31;
+    std::uint32_t code;
+
+    /* Grammars by id, in chunks that never move once allocated, so looking
+    one up takes no lock while others are being created elsewhere */
+    static constexpr size_t chunk_bits = 16;
+    static constexpr size_t max_chunks = size_t(1) << (31 - chunk_bits);
+    static std::atomic<const grammar* const*> chunks[max_chunks];
+
+    static const grammar& grammar_of(std::uint32_t id) {
+        const auto chunk = chunks[id >> chunk_bits].load(std::memory_order_acquire);
+        return *chunk[id & ((std::uint32_t(1) << chunk_bits) - 1)];
+    }
 
-    friend class prod_rule;
-};
+    static std::uint32_t id_of(const grammar&);
 
-inline bool operator==(const symbol& lhs, const symbol& rhs) { return lhs.container == rhs.container; }
-inline bool operator!=(const symbol& lhs, const symbol& rhs) { return !(lhs == rhs); }
+    // A free id, held by gram until released
+    static std::uint32_t acquire_id(const grammar& gram);
+    static void release_id(std::uint32_t id);
+
+    friend class grammar;
+};
 
 } // End of namespace cfg_parser
 
@@ -97,12 +123,7 @@ struct hash<cfg_parser::nonterminal> {
 
 template<>
 struct hash<cfg_parser::symbol> {
-    size_t operator()(cfg_parser::symbol symb) const {
-        return std::hash<std::variant<
-            cfg_parser::terminal,
-            cfg_parser::nonterminal>
-        >{}(symb.container);
-    }
+    size_t operator()(cfg_parser::symbol symb) const { return symb.code; }
 };
 
 } // End of namespace std
\ No newline at end of file
@@ -0,0 +1,622 @@
+#include "compiled_grammar_impl.hpp"
+#include "parser_impl_top_down.hpp"
+#include "parser_impl_cyk.hpp"
+#include "parser_impl_earley.hpp"
+#include "parser_impl_mapped_file.hpp"
+
+#include <unordered_map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bitset>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+using std::vector;
+using std::string;
+using std::unordered_map;
+using std::invalid_argument;
+
+using namespace cfg_parser;
+
+namespace internal_compiled_grammar {
+
+// Gives every nont reachable from gram an id, in the order gram.dfs visits them
+template <typename code>
+vector<nonterminal> number_nonts(const grammar& gram, unordered_map<nonterminal, code>& ids) {
+    vector<nonterminal> nonts;
+    gram.dfs(
+        [&](nonterminal nont) {
+            ids.emplace(nont, static_cast<code>(nonts.size()));
+            nonts.push_back(nont);
+        }
+    );
+
+    return nonts;
+}
+
+struct signature_hash {
+    size_t operator()(const vector<std::uint64_t>& sig) const {
+        size_t seed = sig.size();
+        for (const auto elem : sig) {
+            seed ^= std::hash<std::uint64_t>()(elem) + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+        }
+
+        return seed;
+    }
+};
+
+/* Numbers the classes of equivalent nonts of a normalized form, where nonts
+are equivalent if their rules are the same once every nont is replaced by
+its class. Like minimizing a DFA, it starts off with a single class and
+splits classes by the rules of their nonts, hash-consed, until none splits.
+Only classes using a nont that moved are split again, and the largest part
+keeps its class so that nonts rarely move. Classes are numbered in order of
+their first nont, so nonts[0] is in class 0. */
+template <typename code>
+vector<code> merge_equivalent(const vector<nonterminal>& nonts, const unordered_map<nonterminal, code>& ids) {
+    constexpr std::uint64_t term_rule  = std::uint64_t(1) << 63;
+    constexpr std::uint64_t empty_rule = std::uint64_t(1) << 62;
+
+    // Rules of every nont, terminal and empty ones encoded once as they don't depend on classes
+    vector<vector<std::uint64_t>> fixed_rules(nonts.size());
+    vector<vector<std::pair<code, code>>> pair_rules(nonts.size());
+    vector<vector<code>> users(nonts.size()); // Nonts with a pair rule mentioning it
+    for (size_t id = 0; id < nonts.size(); id++) {
+        for (const auto& rule : *nonts[id]) {
+            if (rule.is_empty()) {
+                fixed_rules[id].push_back(empty_rule);
+            } else if (rule.size() == 1) {
+                fixed_rules[id].push_back(term_rule | static_cast<unsigned char>(rule.front().as_term().get()));
+            } else {
+                const code left  = ids.at(rule.front().as_nont());
+                const code right = ids.at(rule.back().as_nont());
+                pair_rules[id].emplace_back(left, right);
+                users[left].push_back(static_cast<code>(id));
+                users[right].push_back(static_cast<code>(id));
+            }
+        }
+    }
+
+    vector<code> class_of(nonts.size(), 0);
+    vector<vector<code>> members(1);
+    for (size_t id = 0; id < nonts.size(); id++) members[0].push_back(static_cast<code>(id));
+
+    vector<code> to_split = { 0 };
+    vector<bool> queued   = { true };
+    const auto signature = [&](code id) {
+        vector<std::uint64_t> sig = fixed_rules[id];
+        for (const auto& [left, right] : pair_rules[id]) {
+            sig.push_back(std::uint64_t(class_of[left]) << 32 | class_of[right]);
+        }
+
+        std::sort(sig.begin(), sig.end());
+        sig.erase(std::unique(sig.begin(), sig.end()), sig.end());
+        return sig;
+    };
+
+    while (!to_split.empty()) {
+        const code cls = to_split.back();
+        to_split.pop_back();
+        queued[cls] = false;
+        if (members[cls].size() < 2) continue;
+
+        unordered_map<vector<std::uint64_t>, vector<code>, signature_hash> parts;
+        for (const auto id : members[cls]) parts[signature(id)].push_back(id);
+        if (parts.size() == 1) continue;
+
+        const auto largest = std::max_element(
+            parts.begin(), parts.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.second.size() < rhs.second.size(); }
+        );
+
+        vector<code> moved;
+        for (auto it = parts.begin(); it != parts.end(); ++it) {
+            if (it == largest) continue;
+
+            const auto new_cls = static_cast<code>(members.size());
+            for (const auto id : it->second) class_of[id] = new_cls;
+            moved.insert(moved.end(), it->second.begin(), it->second.end());
+            members.push_back(std::move(it->second));
+            queued.push_back(false);
+        }
+
+        members[cls] = std::move(largest->second);
+
+        // Only once every part has its class, so users that moved too are queued in theirs
+        for (const auto id : moved) {
+            for (const auto user : users[id]) {
+                if (queued[class_of[user]]) continue;
+                queued[class_of[user]] = true;
+                to_split.push_back(class_of[user]);
+            }
+        }
+    }
+
+    // Renumbered in order of their first nont
+    const auto none = static_cast<code>(-1);
+    vector<code> number(members.size(), none);
+    code num_classes = 0;
+    for (auto& cls : class_of) {
+        if (number[cls] == none) number[cls] = num_classes++;
+        cls = number[cls];
+    }
+
+    return class_of;
+}
+
+// __Binary format__
+
+/* Bumped whenever the layout changes, as images are only ever loaded by the
+version that saved them rather than converted */
+constexpr std::uint32_t format_version = 2;
+constexpr char magic[8] = { 'c', 'f', 'g', 'g', 'r', 'a', 'm', '\0' };
+constexpr std::uint32_t byte_order_mark = 0x01020304; // Reads differently on the other byte order
+
+// Tables in the order they're laid out
+enum class table_index : size_t {
+    term_nonts, nont_pairs, pair_rules,
+    right_begin, rights, head_begin, heads,
+    symbols, rule_begin, nont_rules, nullable, name_chars, name_begin, num_tables
+};
+
+constexpr size_t num_tables = static_cast<size_t>(table_index::num_tables);
+constexpr size_t table_alignment = 8;
+
+} // End of namespace internal_compiled_grammar
+
+// Tables as they're built, before being packed into the image
+struct compiled_grammar::impl::builder {
+    vector<word> term_nonts;
+    vector<code> nont_pairs;
+    vector<code> pair_rules;
+    vector<code>       right_begin;
+    vector<right_word> rights;
+    vector<code>       head_begin;
+    vector<head_word>  heads;
+
+    vector<code>          symbols;
+    vector<code>          rule_begin;
+    vector<code>          nont_rules;
+    vector<unsigned char> nullable;
+
+    vector<char> name_chars;
+    vector<code> name_begin;
+};
+
+// Leads the image, followed by the tables it locates
+struct compiled_grammar::impl::header {
+    char          magic[8];
+    std::uint32_t format;
+    std::uint32_t byte_order;
+    std::uint64_t version;
+    std::uint64_t has_norm_form;
+    std::uint64_t accepts_empty;
+    std::uint64_t num_nonts;
+    std::uint64_t num_merged_nonts;
+    std::uint64_t num_pruned_nonts;
+    std::uint64_t num_pruned_rules;
+    std::uint64_t num_words;
+
+    struct table_range {
+        std::uint64_t offset; // In bytes from the start of the image
+        std::uint64_t size;   // In elements
+    } tables[internal_compiled_grammar::num_tables];
+};
+
+struct compiled_grammar::impl::owned_image : image {
+    vector<std::uint64_t> buffer; // Aligned like every table in it
+};
+
+struct compiled_grammar::impl::mapped_image : image {
+    parser::impl::mapped_file file;
+
+    mapped_image(const string& file_name) : file(file_name) {
+        data = file.data();
+        size = file.size();
+    }
+};
+
+compiled_grammar::impl::
+impl(const grammar& gram, const name_map& names, std::uint64_t version) : version(version) {
+    builder built;
+    compile(gram, names, built);
+    pack(built);
+}
+
+compiled_grammar::impl::
+impl(
+    const grammar& gram, const grammar& norm_form, const name_map& names, std::uint64_t version,
+    size_t num_pruned_nonts, size_t num_pruned_rules
+) : version(version), num_pruned_nonts(num_pruned_nonts), num_pruned_rules(num_pruned_rules) {
+    builder built;
+    compile(gram, names, built);
+    compile_norm_form(norm_form, built);
+    pack(built);
+}
+
+compiled_grammar::impl::
+impl(std::unique_ptr<image> loaded) : img(std::move(loaded)) {
+    view();
+}
+
+void compiled_grammar::impl::
+compile(const grammar& gram, const name_map& names, builder& built) {
+    unordered_map<nonterminal, code> ids;
+    const auto nonts = internal_compiled_grammar::number_nonts(gram, ids);
+
+    auto& symbols    = built.symbols;
+    auto& rule_begin = built.rule_begin;
+    auto& nont_rules = built.nont_rules;
+    for (code id = 0; id < nonts.size(); id++) {
+        nont_rules.push_back(rule_begin.size());
+        for (const auto& rule : *nonts[id]) {
+            rule_begin.push_back(symbols.size());
+            for (const auto& symb : rule) {
+                if (symb.is_term()) {
+                    symbols.push_back(term_flag | static_cast<unsigned char>(symb.as_term().get()));
+                    continue;
+                }
+
+                symbols.push_back(ids.at(symb.as_nont()));
+            }
+
+            symbols.push_back(end_flag | id);
+        }
+
+        built.name_begin.push_back(built.name_chars.size());
+        const auto name_it = names.find(nonts[id]);
+        if (name_it != names.end())
+            built.name_chars.insert(built.name_chars.end(), name_it->second.begin(), name_it->second.end());
+    }
+
+    nont_rules.push_back(rule_begin.size());
+    built.name_begin.push_back(built.name_chars.size());
+    compute_nullable(built);
+}
+
+// A nont is nullable iff one of its rules has only nullable nonts
+void compiled_grammar::impl::
+compute_nullable(builder& built) {
+    const auto& symbols    = built.symbols;
+    const auto& rule_begin = built.rule_begin;
+    const auto& nont_rules = built.nont_rules;
+    auto& nullable = built.nullable;
+
+    const size_t num_raw_nonts = nont_rules.size() - 1;
+    nullable.assign(num_raw_nonts, false);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t id = 0; id < num_raw_nonts; id++) {
+            if (nullable[id]) continue;
+            for (size_t r = nont_rules[id]; r < nont_rules[id + 1] && !nullable[id]; r++) {
+                size_t pos = rule_begin[r];
+                while (!is_end(symbols[pos]) &&
+                       !is_term(symbols[pos]) &&
+                       nullable[symbols[pos]]) pos++;
+
+                if (is_end(symbols[pos])) nullable[id] = changed = true;
+            }
+        }
+    }
+}
+
+void compiled_grammar::impl::
+compile_norm_form(const grammar& norm_form, builder& built) {
+    unordered_map<nonterminal, code> ids;
+    const auto nonts = internal_compiled_grammar::number_nonts(norm_form, ids);
+
+    // Equivalent nonts share an id, that of their class
+    const auto class_of = internal_compiled_grammar::merge_equivalent(nonts, ids);
+    const auto id_of = [&](const symbol& symb) { return class_of[ids.at(symb.as_nont())]; };
+
+    vector<nonterminal> members; // The first nont of every class
+    for (size_t i = 0; i < nonts.size(); i++) {
+        if (class_of[i] == members.size()) members.push_back(nonts[i]);
+    }
+
+    has_norm_form = true;
+    accepts_empty = norm_form.contains("");
+    num_nonts = members.size();
+    num_merged_nonts = nonts.size() - members.size();
+    num_words = (num_nonts + word_bits - 1) / word_bits;
+    built.term_nonts.assign(256 * num_words, 0);
+
+    // (B, C) -> {A}, where B * num_nonts + C encodes (B, C)
+    unordered_map<size_t, vector<code>> heads_of;
+    vector<vector<code>> rights_of(num_nonts);
+
+    for (code id = 0; id < num_nonts; id++) {
+        built.nont_pairs.push_back(built.pair_rules.size() / 2);
+
+        // Rules distinct in the class may be the same once merged
+        vector<std::pair<code, code>> pairs;
+        for (const auto& rule : *members[id]) {
+            if (rule.size() == 1) {
+                const auto ch = static_cast<unsigned char>(rule.front().as_term().get());
+                built.term_nonts[ch * num_words + id / word_bits] |= word(1) << id % word_bits;
+                continue;
+            }
+
+            if (rule.size() != 2) continue; // The empty rule
+            pairs.emplace_back(id_of(rule.front()), id_of(rule.back()));
+        }
+
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+        for (const auto& [left, right] : pairs) {
+            built.pair_rules.push_back(left);
+            built.pair_rules.push_back(right);
+
+            const auto [it, inserted] = heads_of.try_emplace(size_t(left) * num_nonts + right);
+            if (inserted) rights_of[left].push_back(right);
+            it->second.push_back(id);
+        }
+    }
+
+    built.nont_pairs.push_back(built.pair_rules.size() / 2);
+
+    built.right_begin.reserve(num_nonts + 1);
+    for (code left = 0; left < num_nonts; left++) {
+        built.right_begin.push_back(built.rights.size());
+        auto& rights = rights_of[left];
+        std::sort(rights.begin(), rights.end());
+        for (const auto right : rights) {
+            // Starts a new word unless right falls in the last one of the row
+            const code index = right / word_bits;
+            if (built.rights.size() == built.right_begin.back() || built.rights.back().index != index)
+                built.rights.push_back({ index, static_cast<code>(built.head_begin.size()), 0 });
+
+            built.rights.back().bits |= word(1) << right % word_bits;
+
+            // Heads were added in increasing order
+            built.head_begin.push_back(built.heads.size());
+            for (const auto pair_head : heads_of.at(size_t(left) * num_nonts + right)) {
+                const code head_index = pair_head / word_bits;
+                if (built.heads.size() == built.head_begin.back() || built.heads.back().index != head_index)
+                    built.heads.push_back({ head_index, 0, 0 });
+
+                built.heads.back().bits |= word(1) << pair_head % word_bits;
+            }
+        }
+    }
+
+    built.right_begin.push_back(built.rights.size());
+    built.head_begin.push_back(built.heads.size());
+}
+
+void compiled_grammar::impl::
+pack(const builder& built) {
+    using namespace internal_compiled_grammar;
+
+    header head{};
+    std::memcpy(head.magic, magic, sizeof(magic));
+    head.format           = format_version;
+    head.byte_order       = byte_order_mark;
+    head.version          = version;
+    head.has_norm_form    = has_norm_form;
+    head.accepts_empty    = accepts_empty;
+    head.num_nonts        = num_nonts;
+    head.num_merged_nonts = num_merged_nonts;
+    head.num_pruned_nonts = num_pruned_nonts;
+    head.num_pruned_rules = num_pruned_rules;
+    head.num_words        = num_words;
+
+    size_t size = sizeof(header);
+    const auto place = [&](table_index index, const auto& tab) {
+        const size_t num_bytes = tab.size() * sizeof(tab[0]);
+        head.tables[static_cast<size_t>(index)] = { size, tab.size() };
+        size += (num_bytes + table_alignment - 1) / table_alignment * table_alignment;
+    };
+
+    place(table_index::term_nonts,  built.term_nonts);
+    place(table_index::nont_pairs,  built.nont_pairs);
+    place(table_index::pair_rules,  built.pair_rules);
+    place(table_index::right_begin, built.right_begin);
+    place(table_index::rights,      built.rights);
+    place(table_index::head_begin,  built.head_begin);
+    place(table_index::heads,       built.heads);
+    place(table_index::symbols,     built.symbols);
+    place(table_index::rule_begin,  built.rule_begin);
+    place(table_index::nont_rules,  built.nont_rules);
+    place(table_index::nullable,    built.nullable);
+    place(table_index::name_chars,  built.name_chars);
+    place(table_index::name_begin,  built.name_begin);
+
+    auto packed = std::make_unique<owned_image>();
+    packed->buffer.assign(size / sizeof(std::uint64_t), 0); // Zeroes the padding too
+    auto* const data = reinterpret_cast<unsigned char*>(packed->buffer.data());
+    std::memcpy(data, &head, sizeof(header));
+
+    const auto copy = [&](table_index index, const auto& tab) {
+        if (!tab.empty()) std::memcpy(data + head.tables[static_cast<size_t>(index)].offset, tab.data(), tab.size() * sizeof(tab[0]));
+    };
+
+    copy(table_index::term_nonts,  built.term_nonts);
+    copy(table_index::nont_pairs,  built.nont_pairs);
+    copy(table_index::pair_rules,  built.pair_rules);
+    copy(table_index::right_begin, built.right_begin);
+    copy(table_index::rights,      built.rights);
+    copy(table_index::head_begin,  built.head_begin);
+    copy(table_index::heads,       built.heads);
+    copy(table_index::symbols,     built.symbols);
+    copy(table_index::rule_begin,  built.rule_begin);
+    copy(table_index::nont_rules,  built.nont_rules);
+    copy(table_index::nullable,    built.nullable);
+    copy(table_index::name_chars,  built.name_chars);
+    copy(table_index::name_begin,  built.name_begin);
+
+    packed->data = data;
+    packed->size = size;
+    img = std::move(packed);
+    view();
+}
+
+/* Points every table into the image, after checking the header and that the
+tables fit in it and agree on their sizes. Their contents are trusted, so
+loading costs the same however large the grammar is. */
+void compiled_grammar::impl::
+view() {
+    using namespace internal_compiled_grammar;
+
+    static_assert(std::is_trivially_copyable_v<header>);
+
+    header head;
+    if (img->size < sizeof(header))
+        throw invalid_argument("Not a compiled grammar.");
+
+    std::memcpy(&head, img->data, sizeof(header));
+    if (std::memcmp(head.magic, magic, sizeof(magic)) != 0)
+        throw invalid_argument("Not a compiled grammar.");
+
+    if (head.byte_order != byte_order_mark)
+        throw invalid_argument("Compiled grammar was saved with another byte order.");
+
+    if (head.format != format_version)
+        throw invalid_argument("Compiled grammar has format " + std::to_string(head.format) +
+                               " rather than " + std::to_string(format_version) + ".");
+
+    version          = head.version;
+    has_norm_form    = head.has_norm_form;
+    accepts_empty    = head.accepts_empty;
+    num_nonts        = head.num_nonts;
+    num_merged_nonts = head.num_merged_nonts;
+    num_pruned_nonts = head.num_pruned_nonts;
+    num_pruned_rules = head.num_pruned_rules;
+    num_words        = head.num_words;
+
+    const auto view_table = [&](table_index index, auto& tab) {
+        using elem = std::remove_const_t<std::remove_reference_t<decltype(tab[0])>>;
+        const auto [offset, size] = head.tables[static_cast<size_t>(index)];
+        if (offset % alignof(elem) != 0 || offset > img->size || size > (img->size - offset) / sizeof(elem))
+            throw invalid_argument("Compiled grammar is truncated.");
+
+        tab = table<elem>(reinterpret_cast<const elem*>(img->data + offset), size);
+    };
+
+    view_table(table_index::term_nonts,  term_nonts);
+    view_table(table_index::nont_pairs,  nont_pairs);
+    view_table(table_index::pair_rules,  pair_rules);
+    view_table(table_index::right_begin, right_begin);
+    view_table(table_index::rights,      rights);
+    view_table(table_index::head_begin,  head_begin);
+    view_table(table_index::heads,       heads);
+    view_table(table_index::symbols,     symbols);
+    view_table(table_index::rule_begin,  rule_begin);
+    view_table(table_index::nont_rules,  nont_rules);
+    view_table(table_index::nullable,    nullable);
+    view_table(table_index::name_chars,  name_chars);
+    view_table(table_index::name_begin,  name_begin);
+
+    const size_t num_raw_nonts = nont_rules.size() - 1;
+    const bool raw_consistent =
+        nont_rules.size() >= 2 &&
+        nont_rules[num_raw_nonts] == rule_begin.size() &&
+        nullable.size() == num_raw_nonts &&
+        name_begin.size() == nont_rules.size() &&
+        name_begin[num_raw_nonts] == name_chars.size();
+
+    const bool norm_consistent = !has_norm_form || (
+        num_nonts > 0 &&
+        num_words == (num_nonts + word_bits - 1) / word_bits &&
+        term_nonts.size() == 256 * num_words &&
+        nont_pairs.size() == num_nonts + 1 &&
+        pair_rules.size() == 2 * size_t(nont_pairs[num_nonts]) &&
+        right_begin.size() == num_nonts + 1 &&
+        rights.size() == right_begin[num_nonts] &&
+        head_begin.size() >= 1 &&
+        heads.size() == head_begin[head_begin.size() - 1]
+    );
+
+    if (!raw_consistent || !norm_consistent)
+        throw invalid_argument("Compiled grammar is corrupt.");
+}
+
+std::unique_ptr<compiled_grammar::impl::image> compiled_grammar::impl::
+open_image(const string& file_name) {
+    return std::make_unique<mapped_image>(file_name);
+}
+
+compiled_grammar::compiled_grammar(
+    const grammar& gram, const std::unordered_map<nonterminal, string>& names, std::uint64_t version
+) : pimpl(std::make_unique<impl>(gram, names, version)) {}
+
+compiled_grammar::compiled_grammar(
+    const grammar& gram, const grammar& norm_form,
+    const std::unordered_map<nonterminal, string>& names, std::uint64_t version,
+    size_t num_pruned_nonts, size_t num_pruned_rules
+) : pimpl(std::make_unique<impl>(gram, norm_form, names, version, num_pruned_nonts, num_pruned_rules)) {}
+
+compiled_grammar::compiled_grammar(std::unique_ptr<const impl> pimpl) : pimpl(std::move(pimpl)) {}
+
+compiled_grammar::~compiled_grammar() = default;
+
+size_t compiled_grammar::num_nonterminals() const {
+    return pimpl->num_nonts;
+}
+
+size_t compiled_grammar::num_merged_nonterminals() const {
+    return pimpl->num_merged_nonts;
+}
+
+size_t compiled_grammar::num_pruned_nonterminals() const {
+    return pimpl->num_pruned_nonts;
+}
+
+size_t compiled_grammar::num_pruned_rules() const {
+    return pimpl->num_pruned_rules;
+}
+
+std::uint64_t compiled_grammar::version() const {
+    return pimpl->version;
+}
+
+std::string_view compiled_grammar::name() const {
+    return pimpl->name_of(0);
+}
+
+size_t compiled_grammar::num_rules() const {
+    size_t num_term_rules = 0;
+    for (const auto bits : pimpl->term_nonts) {
+        num_term_rules += std::bitset<impl::word_bits>(bits).count();
+    }
+
+    return num_term_rules + pimpl->pair_rules.size() / 2 + pimpl->accepts_empty;
+}
+
+bool compiled_grammar::parse(const string& word, parse_engine engine) const {
+    if (engine != parse_engine::earley && !pimpl->has_norm_form)
+        throw std::logic_error("Grammar was compiled without its normalized form.");
+
+    switch (engine) {
+    case parse_engine::top_down:
+        return parser::impl::top_down(*this)(word);
+    case parse_engine::cyk:
+        return parser::impl::cyk(*this)(word);
+    case parse_engine::earley:
+        return parser::impl::earley(*this)(word);
+    }
+
+    throw std::invalid_argument("Unknown parse engine.");
+}
+
+void compiled_grammar::save(const string& file_name) const {
+    std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+    if (!out) throw invalid_argument("Couldn't open " + file_name + ".");
+
+    const auto& img = pimpl->get_image();
+    out.write(reinterpret_cast<const char*>(img.data), img.size);
+    if (!out) throw invalid_argument("Couldn't write " + file_name + ".");
+}
+
+std::shared_ptr<const compiled_grammar> compiled_grammar::load(const string& file_name) {
+    auto loaded = std::make_unique<const impl>(impl::open_image(file_name));
+    return std::shared_ptr<const compiled_grammar>(new compiled_grammar(std::move(loaded)));
+}
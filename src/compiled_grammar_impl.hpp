@@ -0,0 +1,159 @@
+#pragma once
+
+#include "cfg_parser.hpp"
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+
+namespace cfg_parser {
+
+class compiled_grammar::impl {
+
+public:
+    using word = std::uint64_t;
+    using code = std::uint32_t;
+    static constexpr size_t word_bits = 64;
+
+    // A read-only array inside the image
+    template <typename T>
+    class table {
+
+    public:
+        table() = default;
+        table(const T* data, size_t size) : data(data), len(size) {}
+
+        const T& operator[](size_t i) const { return data[i]; }
+        size_t size() const { return len; }
+
+        const T* begin() const { return data; }
+        const T* end()   const { return data + len; }
+
+    private:
+        const T* data = nullptr;
+        size_t   len  = 0;
+    };
+
+    /* Every table views the image, laid out exactly as compiled_grammar::save
+    writes it: a header, then each table at an offset aligned to 8 bytes.
+    Compiling builds it in memory, loading maps the file in place. */
+    struct image {
+        const unsigned char* data = nullptr;
+        size_t size = 0;
+
+        virtual ~image() = default;
+    };
+
+    std::uint64_t version = 0;
+
+    // __Normalized form__
+    /* Nonts reachable from the norm_form have dense ids, the norm_form itself has
+    id 0. Equivalent nonts, with the same rules up to merging, share their id. */
+
+    bool   has_norm_form = false;
+    bool   accepts_empty = false;
+    size_t num_nonts = 0;
+    size_t num_merged_nonts = 0;
+    size_t num_pruned_nonts = 0;
+    size_t num_pruned_rules = 0;
+    size_t num_words = 0; // per bitset of nonts
+
+    // Bitset of nonts A with A -> ch, for every char ch
+    table<word> term_nonts;
+
+    // Pair rules A -> B C are (B, C) at pair_rules[2 * r] for r in [nont_pairs[A], nont_pairs[A + 1])
+    table<code> nont_pairs;
+    table<code> pair_rules;
+
+    /* Reverse index (B, C) -> {A}, row-packed so CYK tests 64 nonts C and
+    adds 64 nonts A per word. For every nont B and i in
+    [right_begin[B], right_begin[B + 1]), word rights[i].index of a bitset
+    of nonts C with some A -> B C is rights[i].bits. Their pairs (B, C) are
+    numbered from rights[i].first_pair up, in the order of their bits, and
+    for pair p and h in [head_begin[p], head_begin[p + 1]), word
+    heads[h].index of the bitset of all those A is heads[h].bits. Only
+    nonzero words are kept, so it grows linearly with the grammar however
+    many nonts there are. */
+    struct right_word {
+        code index;
+        code first_pair;
+        word bits;
+    };
+
+    struct head_word {
+        code index;
+        code unused = 0; // Keeps the padding saved zeroed
+        word bits;
+    };
+
+    table<code>       right_begin;
+    table<right_word> rights;
+    table<code>       head_begin;
+    table<head_word>  heads;
+
+    // __Grammar as written__
+    // Nonts reachable from the grammar have dense ids, the grammar itself has id 0
+
+    static constexpr code term_flag = code(1) << 31;
+    static constexpr code end_flag  = code(1) << 30; // Ends a rule, tagged with its lhs
+
+    static bool is_term(code symb) { return symb & term_flag; }
+    static bool is_end (code symb) { return symb & end_flag;  }
+
+    // Rules of nont A start at symbols[rule_begin[r]] for r in [nont_rules[A], nont_rules[A + 1])
+    table<code>          symbols;
+    table<code>          rule_begin;
+    table<code>          nont_rules;
+    table<unsigned char> nullable;
+
+    // The name of nont A is name_chars[name_begin[A], name_begin[A + 1])
+    table<char> name_chars;
+    table<code> name_begin;
+
+    using name_map = std::unordered_map<nonterminal, std::string>;
+
+    impl(const grammar& gram, const name_map& names, std::uint64_t version);
+    impl(
+        const grammar& gram, const grammar& norm_form, const name_map& names, std::uint64_t version,
+        size_t num_pruned_nonts, size_t num_pruned_rules
+    );
+
+    // Views an image saved before, throwing std::invalid_argument if it's malformed
+    explicit impl(std::unique_ptr<image>);
+
+    // Maps the file read-only, or reads it in where mmap is missing
+    static std::unique_ptr<image> open_image(const std::string& file_name);
+
+    bool derives_term(code nont, char ch) const {
+        const auto index = static_cast<unsigned char>(ch) * num_words + nont / word_bits;
+        return term_nonts[index] >> nont % word_bits & 1;
+    }
+
+    std::string_view name_of(code nont) const {
+        return { name_chars.begin() + name_begin[nont], name_begin[nont + 1] - name_begin[nont] };
+    }
+
+    const image& get_image() const { return *img; }
+
+    struct header; // of the image
+
+private:
+    struct builder;
+    struct owned_image;
+    struct mapped_image;
+
+    std::unique_ptr<image> img;
+
+    void compile(const grammar& gram, const name_map& names, builder&);
+    void compile_norm_form(const grammar& norm_form, builder&);
+    static void compute_nullable(builder&);
+
+    // Lays the built tables out into a fresh image, then views it
+    void pack(const builder&);
+    void view();
+};
+
+}
@@ -1,10 +1,12 @@
 
 #include "cfg_parser.hpp"
+#include "grammar_rule_set.hpp"
 
 #include <unordered_set>
 #include <unordered_map>
 #include <queue>
 #include <stdexcept>
+#include <cstdint>
 
 using std::unordered_set;
 using std::unordered_map;
@@ -20,21 +22,26 @@ class grammar::impl {
 
 public:
     const grammar* const this_gram; // Ptr to parent grammar
+    const std::uint32_t  id;        // of its symbols, see symbol
 
     unordered_set<terminal>    terminals;
     unordered_set<nonterminal> nonterminals;
-    unordered_set<prod_rule>   production_rules;
+    rule_set                   production_rules;
 
     /* Whether terminals and nonterminals aren't up
     to date with the contents of production_rules */
     bool needs_update = false;
 
-    impl(const grammar* ptr) : this_gram(ptr) {}
-    impl(const grammar* ptr, std::unordered_set<prod_rule> rules)
-        : this_gram(ptr), production_rules(rules) {}
+    impl(const grammar* ptr) : this_gram(ptr), id(symbol::acquire_id(*ptr)) {}
+    impl(const grammar* ptr, const rule_set& rules)
+        : this_gram(ptr), id(symbol::acquire_id(*ptr)), production_rules(rules) {}
 
     impl(const grammar* ptr, initializer_list<prod_rule> init)
-        : this_gram(ptr), production_rules(init) {}  
+        : this_gram(ptr), id(symbol::acquire_id(*ptr)) {
+        for (const auto& rule : init) production_rules.insert(rule);
+    }
+
+   ~impl() { symbol::release_id(id); }
 
     /* A prod_rule rule is redundant wrt
     its grammar gram if rule == { gram }. */
@@ -95,6 +102,10 @@ void grammar::impl::update_members() {
     }
 }
 
+std::uint32_t symbol::id_of(const grammar& gram) {
+    return gram.pimpl->id;
+}
+
 grammar::grammar() : pimpl(std::make_unique<impl>(this)) {}
 
 grammar::grammar(initializer_list<prod_rule> init)
@@ -139,7 +150,8 @@ grammar& grammar::operator=(initializer_list<prod_rule> init) {
             throw std::invalid_argument("Grammar cannot contain redundant rule.");
     }
 
-    pimpl->production_rules = init;
+    pimpl->production_rules.clear();
+    for (const auto& rule : init) pimpl->production_rules.insert(rule);
     pimpl->needs_update = true;
     return *this;
 }
@@ -179,7 +191,7 @@ bool grammar::is_empty() const {
 }
 
 bool grammar::contains(const prod_rule& target) const {
-    return pimpl->production_rules.count(target);
+    return pimpl->production_rules.contains(target);
 }
 
 bool grammar::insert(const prod_rule& rule) {
@@ -197,19 +209,19 @@ bool grammar::insert(prod_rule&& rule) {
     if (pimpl->is_redundant(rule))
         throw std::invalid_argument("Grammar cannot contain redundant rule.");
 
-    const auto [it, is_inserted] = pimpl->production_rules.insert(std::move(rule));
+    const auto [stored, is_inserted] = pimpl->production_rules.insert(std::move(rule));
     if (is_inserted && !pimpl->needs_update)
-        pimpl->insert_members(*it);
+        pimpl->insert_members(*stored);
 
     return is_inserted;
 }
 
 bool grammar::erase(const prod_rule& rule) {
-    size_t num_erased = pimpl->production_rules.erase(rule);
-    if (num_erased > 0)
+    const bool is_erased = pimpl->production_rules.erase(rule);
+    if (is_erased)
         pimpl->needs_update = true;
 
-    return num_erased > 0;
+    return is_erased;
 }
 
 void grammar::clear() { 
@@ -242,10 +254,7 @@ grammar& grammar::operator*=(const grammar& gram) {
     }
     pimpl->production_rules.clear();
     while (!rules.empty()) {
-        pimpl->production_rules.insert(
-            pimpl->production_rules.end(),
-            rules.front()
-        );
+        pimpl->production_rules.insert(std::move(rules.front()));
         rules.pop();
     }
 
@@ -0,0 +1,220 @@
+#include "grammar_rule_pool.hpp"
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <optional>
+#include <functional>
+#include <stdexcept>
+
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+
+using namespace cfg_parser;
+
+std::atomic<const prod_rule*> grammar::pool_chunks[grammar::pool_max_chunks];
+
+struct grammar::rule_pool::state {
+    static constexpr size_t chunk_size = size_t(1) << pool_chunk_bits;
+    static constexpr size_t num_shards = 64;
+
+    /* Ids by the hash of their rule, in a table probed linearly and kept
+    at most half full, where an id of 0 marks a free slot */
+    struct shard {
+        struct entry {
+            size_t hash;
+            std::uint32_t id_plus_one;
+        };
+
+        mutex mtx;
+        vector<entry> slots;
+        size_t num_ids = 0;
+
+        size_t home_of(size_t hash) const {
+            return (hash ^ (hash >> 29)) & (slots.size() - 1);
+        }
+
+        size_t next(size_t slot) const { return (slot + 1) & (slots.size() - 1); }
+
+        void insert(size_t hash, std::uint32_t id);
+        void erase(size_t hash, std::uint32_t id);
+    };
+
+    shard shards[num_shards];
+
+    // Reference counts and rule hashes by id, chunked like pool_chunks
+    std::atomic<std::atomic<std::uint32_t>*> ref_chunks[pool_max_chunks];
+    std::atomic<size_t*> hash_chunks[pool_max_chunks];
+
+    mutex ids_mtx;
+    vector<std::uint32_t> released;
+    std::uint32_t num_ids = 0; // ever handed out
+
+    static shard& shard_of(state& st, size_t hash) {
+        static_assert(num_shards == 64, "The top 6 bits pick the shard");
+        return st.shards[(static_cast<std::uint64_t>(hash) * 0x9e3779b97f4a7c15) >> 58];
+    }
+
+    std::atomic<std::uint32_t>& refs(std::uint32_t id) {
+        return ref_chunks[id >> pool_chunk_bits].load(std::memory_order_acquire)[id & (chunk_size - 1)];
+    }
+
+    size_t& hash(std::uint32_t id) {
+        return hash_chunks[id >> pool_chunk_bits].load(std::memory_order_acquire)[id & (chunk_size - 1)];
+    }
+
+    // The chunks are allocated as mutable, only handed out as const
+    static prod_rule& rule(std::uint32_t id) { return const_cast<prod_rule&>(interned(id)); }
+
+    std::uint32_t new_id() {
+        lock_guard<mutex> lock(ids_mtx);
+        if (!released.empty()) {
+            const auto id = released.back();
+            released.pop_back();
+            return id;
+        }
+
+        if (num_ids == pool_max_chunks * chunk_size) throw std::length_error("Too many distinct rules.");
+        const auto id = num_ids++;
+        if (id % chunk_size == 0) {
+            const auto chunk = id >> pool_chunk_bits;
+            pool_chunks[chunk].store(new prod_rule[chunk_size], std::memory_order_release);
+            ref_chunks[chunk].store(new std::atomic<std::uint32_t>[chunk_size], std::memory_order_release);
+            hash_chunks[chunk].store(new size_t[chunk_size], std::memory_order_release);
+        }
+
+        return id;
+    }
+
+    void free_id(std::uint32_t id) {
+        lock_guard<mutex> lock(ids_mtx);
+        released.push_back(id);
+    }
+};
+
+void grammar::rule_pool::state::shard::
+insert(size_t hash, std::uint32_t id) {
+    if (2 * (num_ids + 1) > slots.size()) {
+        vector<entry> old(slots.size() ? 2 * slots.size() : 64, entry{ 0, 0 });
+        old.swap(slots);
+        for (const auto& e : old) {
+            if (!e.id_plus_one) continue;
+            size_t slot = home_of(e.hash);
+            while (slots[slot].id_plus_one) slot = next(slot);
+            slots[slot] = e;
+        }
+    }
+
+    size_t slot = home_of(hash);
+    while (slots[slot].id_plus_one) slot = next(slot);
+    slots[slot] = { hash, id + 1 };
+    num_ids++;
+}
+
+// Shifts back the entries probed past the freed slot, as grammar::rule_set does
+void grammar::rule_pool::state::shard::
+erase(size_t hash, std::uint32_t id) {
+    size_t gap = home_of(hash);
+    while (slots[gap].id_plus_one != id + 1) gap = next(gap);
+
+    for (size_t curr = next(gap); slots[curr].id_plus_one; curr = next(curr)) {
+        const size_t home = home_of(slots[curr].hash);
+        const bool stays = gap <= curr ? (gap < home && home <= curr) : (gap < home || home <= curr);
+        if (stays) continue;
+
+        slots[gap] = slots[curr];
+        gap = curr;
+    }
+
+    slots[gap] = { 0, 0 };
+    num_ids--;
+}
+
+// Never destroyed, as grammars with static storage may release rules after it otherwise would be
+grammar::rule_pool::state& grammar::rule_pool::
+get_state() {
+    static auto* const st = new state;
+    return *st;
+}
+
+std::uint32_t grammar::rule_pool::
+intern(const prod_rule& rule) {
+    return intern_rule(rule);
+}
+
+std::uint32_t grammar::rule_pool::
+intern(prod_rule&& rule) {
+    return intern_rule(std::move(rule));
+}
+
+template <typename rule_arg>
+std::uint32_t grammar::rule_pool::
+intern_rule(rule_arg&& rule) {
+    auto& st = get_state();
+    const size_t hash = std::hash<prod_rule>()(rule);
+    auto& sh = state::shard_of(st, hash);
+    lock_guard<mutex> lock(sh.mtx);
+
+    if (sh.num_ids) {
+        for (size_t slot = sh.home_of(hash); sh.slots[slot].id_plus_one; slot = sh.next(slot)) {
+            const auto& e = sh.slots[slot];
+            if (e.hash != hash || interned(e.id_plus_one - 1) != rule) continue;
+
+            st.refs(e.id_plus_one - 1).fetch_add(1, std::memory_order_relaxed);
+            return e.id_plus_one - 1;
+        }
+    }
+
+    const auto id = st.new_id();
+    state::rule(id) = std::forward<rule_arg>(rule);
+    st.refs(id).store(1, std::memory_order_relaxed);
+    st.hash(id) = hash;
+    sh.insert(hash, id);
+    return id;
+}
+
+std::optional<std::uint32_t> grammar::rule_pool::
+find(const prod_rule& rule) {
+    auto& st = get_state();
+    const size_t hash = std::hash<prod_rule>()(rule);
+    auto& sh = state::shard_of(st, hash);
+    lock_guard<mutex> lock(sh.mtx);
+
+    if (!sh.num_ids) return std::nullopt;
+    for (size_t slot = sh.home_of(hash); sh.slots[slot].id_plus_one; slot = sh.next(slot)) {
+        const auto& e = sh.slots[slot];
+        if (e.hash == hash && interned(e.id_plus_one - 1) == rule) return e.id_plus_one - 1;
+    }
+
+    return std::nullopt;
+}
+
+void grammar::rule_pool::
+retain(std::uint32_t id) {
+    get_state().refs(id).fetch_add(1, std::memory_order_relaxed);
+}
+
+void grammar::rule_pool::
+release(std::uint32_t id) {
+    auto& st = get_state();
+    auto& refs = st.refs(id);
+
+    /* Dropping a reference that isn't the last needs no lock, as only
+    the last one erases the rule, which intern must not find meanwhile */
+    auto num_refs = refs.load(std::memory_order_relaxed);
+    while (num_refs > 1) {
+        if (refs.compare_exchange_weak(num_refs, num_refs - 1, std::memory_order_acq_rel)) return;
+    }
+
+    const size_t hash = st.hash(id);
+    auto& sh = state::shard_of(st, hash);
+    lock_guard<mutex> lock(sh.mtx);
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    sh.erase(hash, id);
+
+    state::rule(id) = prod_rule(); // Frees the heap of a long rule
+    st.free_id(id);
+}
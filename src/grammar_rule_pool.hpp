@@ -0,0 +1,40 @@
+#pragma once
+
+#include "cfg_parser.hpp"
+
+#include <cstdint>
+#include <optional>
+
+namespace cfg_parser {
+
+/* Interns rules process-wide, as grammars live outside any parser, so each
+distinct one is stored once however many grammars hold it, and compared by
+id from then on. Ids are reference-counted: interning a rule or retaining
+its id adds a reference, and the last release frees the rule and its id for
+reuse. Rules are found by hash in shards locked separately, so grammars
+filled on different threads rarely wait for each other. */
+class grammar::rule_pool {
+
+public:
+    // The id of the rule, interning it if no grammar holds it yet
+    static std::uint32_t intern(const prod_rule& rule);
+    static std::uint32_t intern(prod_rule&& rule);
+
+    /* The id of the rule if some grammar holds it, adding no reference, so
+    it only stays the rule's while the caller holds it too */
+    static std::optional<std::uint32_t> find(const prod_rule& rule);
+
+    // Of an id the caller holds already, so it takes no lock
+    static void retain(std::uint32_t id);
+    // Takes a lock only if it may be the last reference
+    static void release(std::uint32_t id);
+
+private:
+    struct state;
+    static state& get_state();
+
+    template <typename rule_arg>
+    static std::uint32_t intern_rule(rule_arg&& rule);
+};
+
+}
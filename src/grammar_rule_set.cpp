@@ -0,0 +1,136 @@
+#include "grammar_rule_set.hpp"
+#include "grammar_rule_pool.hpp"
+
+#include <algorithm>
+
+using std::pair;
+
+using namespace cfg_parser;
+
+grammar::rule_set::
+rule_set(const rule_set& other) : ids(other.ids), slots(other.slots), shift(other.shift) {
+    for (const auto id : ids) rule_pool::retain(id);
+}
+
+grammar::rule_set& grammar::rule_set::
+operator=(const rule_set& other) {
+    if (this == &other) return *this;
+
+    for (const auto id : other.ids) rule_pool::retain(id);
+    release_all();
+    ids   = other.ids;
+    slots = other.slots;
+    shift = other.shift;
+    return *this;
+}
+
+void grammar::rule_set::
+release_all() {
+    for (const auto id : ids) rule_pool::release(id);
+}
+
+size_t grammar::rule_set::
+find_slot(std::uint32_t id) const {
+    size_t slot = home_of(id);
+    while (slots[slot] != free_slot && ids[slots[slot] - 1] != id) slot = next(slot);
+    return slot;
+}
+
+bool grammar::rule_set::
+contains(const prod_rule& rule) const {
+    if (ids.empty()) return false;
+
+    const auto id = rule_pool::find(rule);
+    return id && slots[find_slot(*id)] != free_slot;
+}
+
+pair<const prod_rule*, bool> grammar::rule_set::
+insert(const prod_rule& rule) {
+    return insert_id(rule_pool::intern(rule));
+}
+
+pair<const prod_rule*, bool> grammar::rule_set::
+insert(prod_rule&& rule) {
+    return insert_id(rule_pool::intern(std::move(rule)));
+}
+
+pair<const prod_rule*, bool> grammar::rule_set::
+insert_id(std::uint32_t id) {
+    reserve_slots(ids.size() + 1);
+
+    const size_t slot = find_slot(id);
+    if (slots[slot] != free_slot) {
+        rule_pool::release(id); // Not the last reference, the set holds one
+        return { &interned(id), false };
+    }
+
+    ids.push_back(id);
+    slots[slot] = static_cast<std::uint32_t>(ids.size());
+    return { &interned(id), true };
+}
+
+bool grammar::rule_set::
+erase(const prod_rule& rule) {
+    if (ids.empty()) return false;
+
+    const auto id = rule_pool::find(rule);
+    if (!id) return false;
+
+    size_t gap = find_slot(*id);
+    if (slots[gap] == free_slot) return false;
+    const size_t index = slots[gap] - 1;
+
+    /* Shifts back the rules probed past the freed slot, so lookups
+    needn't skip tombstones: a rule moves into the gap unless its
+    home lies cyclically within (gap, its slot] */
+    for (size_t curr = next(gap); slots[curr] != free_slot; curr = next(curr)) {
+        const size_t home = home_of(ids[slots[curr] - 1]);
+        const bool stays = gap <= curr ? (gap < home && home <= curr) : (gap < home || home <= curr);
+        if (stays) continue;
+
+        slots[gap] = slots[curr];
+        gap = curr;
+    }
+
+    slots[gap] = free_slot;
+
+    rule_pool::release(*id);
+
+    // The last rule fills its place
+    const size_t last = ids.size() - 1;
+    if (index != last) {
+        size_t last_slot = home_of(ids[last]);
+        while (slots[last_slot] != last + 1) last_slot = next(last_slot);
+
+        ids[index] = ids[last];
+        slots[last_slot] = static_cast<std::uint32_t>(index + 1);
+    }
+
+    ids.pop_back();
+    return true;
+}
+
+void grammar::rule_set::
+clear() {
+    release_all();
+    ids.clear();
+    std::fill(slots.begin(), slots.end(), free_slot);
+}
+
+void grammar::rule_set::
+reserve_slots(size_t num_rules) {
+    if (2 * num_rules <= slots.size()) return;
+
+    size_t num_slots = slots.empty() ? 8 : 2 * slots.size();
+    while (2 * num_rules > num_slots) num_slots *= 2;
+
+    shift = 64;
+    for (size_t n = num_slots; n > 1; n >>= 1) shift--;
+
+    slots.assign(num_slots, free_slot);
+    for (size_t index = 0; index < ids.size(); index++) {
+        size_t slot = home_of(ids[index]);
+        while (slots[slot] != free_slot) slot = next(slot);
+        slots[slot] = static_cast<std::uint32_t>(index + 1);
+    }
+}
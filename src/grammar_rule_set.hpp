@@ -0,0 +1,65 @@
+#pragma once
+
+#include "cfg_parser.hpp"
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+namespace cfg_parser {
+
+/* The rules of a grammar, as ids into the rule_pool, kept contiguous in
+insertion order but for erasures, which move the last rule into the gap.
+Rules are interned, or looked up, in the pool once on the way in, so the
+set itself only hashes and compares ids, in an open-addressing table of
+indices into them, probed linearly. Copies share every rule, only adding a
+reference to each. */
+class grammar::rule_set {
+
+public:
+    rule_set() = default;
+    rule_set(const rule_set&);
+    rule_set& operator=(const rule_set&);
+   ~rule_set() { release_all(); }
+
+    const_iterator begin() const { return const_iterator(ids.data()); }
+    const_iterator   end() const { return const_iterator(ids.data() + ids.size()); }
+
+    size_t  size() const { return ids.size();  }
+    bool   empty() const { return ids.empty(); }
+
+    bool contains(const prod_rule&) const;
+
+    // The rule as stored, and whether it wasn't already
+    std::pair<const prod_rule*, bool> insert(const prod_rule&);
+    std::pair<const prod_rule*, bool> insert(prod_rule&&);
+
+    bool erase(const prod_rule&);
+    void clear();
+
+private:
+    std::vector<std::uint32_t> ids;
+    std::vector<std::uint32_t> slots;  // 1 + an index into ids, or 0 if free
+    unsigned shift = 64; // so that an id picks one of slots.size() slots
+
+    static constexpr std::uint32_t free_slot = 0;
+
+    size_t home_of(std::uint32_t id) const {
+        // Fibonacci hashing, as ids are dense
+        return static_cast<size_t>((static_cast<std::uint64_t>(id) * 0x9e3779b97f4a7c15) >> shift);
+    }
+
+    size_t next(size_t slot) const { return (slot + 1) & (slots.size() - 1); }
+
+    // The slot holding id, or the free one where it'd go
+    size_t find_slot(std::uint32_t id) const;
+
+    // Takes over the reference to id the caller holds
+    std::pair<const prod_rule*, bool> insert_id(std::uint32_t id);
+
+    // Keeps slots at most half full
+    void reserve_slots(size_t num_rules);
+    void release_all();
+};
+
+}
@@ -1,21 +1,34 @@
 #include "parser_impl.hpp"
 #include "parser_impl_normalizer.hpp"
+#include "parser_impl_thread_pool.hpp"
+#include "parser_impl_background_compiler.hpp"
+#include "parser_impl_loader.hpp"
+#include "parser_impl_mapped_file.hpp"
 
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <cstdint>
 
 using std::unordered_set;
 using std::unordered_map;
 using std::string;
+using std::string_view;
+using std::vector;
 using std::pair;
 using std::invalid_argument;
+using std::lock_guard;
+using std::mutex;
 
 using namespace cfg_parser;
 
@@ -25,65 +38,56 @@ parser::~parser() = default;
 // Creates a new empty grammar
 
 void parser::create(const string& name) {
-    if (name.empty())
-        throw invalid_argument("Name can't be empty.");
-
-    const auto [it, inserted] = pimpl->gram_map.emplace(
-        name, pimpl.get()
-    );
-
-    if (!inserted)
-        throw invalid_argument(name + " already exists.");
-
-    pimpl->name_map.emplace(nonterminal(it->second.gram), name);
-    pimpl->name_map_for_norm.emplace(nonterminal(it->second.norm_form), name);
+    lock_guard<mutex> lock(pimpl->gram_mtx);
+    pimpl->create_family(name);
 }
 
 // Creates a new grammar initialized with init
 void parser::create(
     const string& name, std::initializer_list<prod_rule> init
 ) {
-    if (name.empty())
-        throw invalid_argument("Name can't be empty.");
-
-    const auto [it, inserted] = pimpl->gram_map.emplace(
-        name, pimpl.get()
-    );
+    lock_guard<mutex> lock(pimpl->gram_mtx);
+    for (const auto& rule : init) pimpl->throw_if_has_foreign(rule);
 
-    if (!inserted) 
-        throw invalid_argument(name + " already exists.");
-
-    for (const auto& rule : init) {
-        pimpl->throw_if_has_foreign(rule);
-        it->second.gram.insert(rule);
-    }
-
-    pimpl->name_map.emplace(nonterminal(it->second.gram), name);
-    pimpl->name_map_for_norm.emplace(nonterminal(it->second.norm_form), name);
+    auto& gram = pimpl->create_family(name).gram;
+    for (const auto& rule : init) gram.insert(rule);
 }
 
 nonterminal parser::get_nont(const string& name) {
     return nonterminal(pimpl->get_if_exists(name));
  }
 
+/* Edits wait for each other and for compilation, but never for parses,
+which keep using the snapshot they started with */
+
 bool parser::insert(const string& name, const prod_rule& rule) {
+    lock_guard<mutex> lock(pimpl->gram_mtx);
     auto& gram = pimpl->get_if_exists(name);
     pimpl->throw_if_has_foreign(rule);
-    return gram.insert(rule);
+    const bool inserted = gram.insert(rule);
+    if (inserted) pimpl->publish_edit(gram);
+    return inserted;
 }
 
 bool parser::insert(const string& name, prod_rule&& rule) {
+    lock_guard<mutex> lock(pimpl->gram_mtx);
     auto& gram = pimpl->get_if_exists(name);
     pimpl->throw_if_has_foreign(rule);    
-    return gram.insert(std::move(rule));
+    const bool inserted = gram.insert(std::move(rule));
+    if (inserted) pimpl->publish_edit(gram);
+    return inserted;
 }
 
 bool parser::erase(const string& name, const prod_rule& rule) {
+    lock_guard<mutex> lock(pimpl->gram_mtx);
     auto& gram = pimpl->get_if_exists(name);
-    return gram.erase(rule);
+    const bool erased = gram.erase(rule);
+    if (erased) pimpl->publish_edit(gram);
+    return erased;
 }
 
 void parser::print(const string& name) {
+    lock_guard<mutex> lock(pimpl->gram_mtx);
     const auto& gram = pimpl->get_if_exists(name);
     gram.dfs(
         [this](nonterminal nont) { 
@@ -93,6 +97,7 @@ void parser::print(const string& name) {
 }
 
 void parser::print_norm(const string& name) {
+    lock_guard<mutex> lock(pimpl->gram_mtx);
     const auto& gram = pimpl->get_norm_if_exists(name);
     gram.dfs(
         [this](nonterminal nont) { 
@@ -101,74 +106,143 @@ void parser::print_norm(const string& name) {
     );
 }
 
-namespace internal_parser {
+std::shared_ptr<const compiled_grammar> parser::compile(const string& name) {
+    auto& gram_fam = pimpl->get_family_if_exists(name);
+    lock_guard<mutex> lock(pimpl->gram_mtx);
+    return gram_fam.up_to_date_form();
+}
 
-// norm_form must be reachable from a normalized grammar
+std::future<std::shared_ptr<const compiled_grammar>> parser::compile_async(const string& name) {
+    return pimpl->get_compiler().submit(pimpl->get_family_if_exists(name));
+}
 
-struct derives {
-    using input_type = pair<nonterminal, string>;
-    struct input_hash { size_t operator()(const input_type&) const; };
-    unordered_set<input_type, input_hash> memo;
-    bool operator()(const grammar&, const string&);
-};
+bool parser::parse(const string& name, const string& text, parse_engine engine) {
+    return pimpl->get_compiled_if_exists(name, engine)->parse(text, engine);
+}
 
-size_t derives::input_hash::operator()(const input_type& input) const {
-    const size_t seed  = std::hash<nonterminal>()(input.first);
-    const size_t value = std::hash<string>()(input.second);
-    return seed ^ value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+vector<bool> parser::parse_batch(
+    const string& name, const vector<string_view>& words, parse_engine engine
+) {
+    return pimpl->parse_batch(*pimpl->get_compiled_if_exists(name, engine), words, engine);
 }
 
-bool derives::operator()(const grammar& norm_form, const string& text) {
-    if (text.empty()) return norm_form.contains("");
-    if (memo.count({ nonterminal(norm_form), text })) {
-        return true;
-    }
+void parser::set_num_threads(size_t num_threads) {
+    std::lock_guard<std::mutex> lock(pimpl->pool_mtx);
+    pimpl->num_threads = num_threads;
+    pimpl->pool.reset(); // Batches still running keep the old one alive
+}
 
-    if (text.size() == 1) {
-        for (const auto& term : norm_form.terminals()) {
-            if (text.front() == term) {
-                memo.emplace(nonterminal(norm_form), text);
-                return true;
-            }
-        }
+void parser::set_binarization(binarization bin) {
+    lock_guard<mutex> lock(pimpl->gram_mtx);
+    pimpl->bin = bin;
+}
 
-        return false;
-    }
-
-    for (const auto& rule : norm_form) {
-        if (rule.size() != 2) continue;
-        const auto& front_gram = *rule.front().as_nont();
-        const auto&  back_gram =  *rule.back().as_nont();
-        for (size_t left_len = 1; left_len < text.size(); left_len++) {
-            if (operator()(front_gram, text.substr(0, left_len)) &&
-                operator()(back_gram,  text.substr(left_len))) {
-                memo.emplace(nonterminal(norm_form), text);
-                return true;
-            }
-        }
-    }
+void parser::set_background_compile(bool enabled) {
+    lock_guard<mutex> lock(pimpl->gram_mtx);
+    pimpl->background_compile = enabled;
+}
+
+void parser::load(const string& file_name) {
+    std::ifstream in(file_name, std::ios::binary | std::ios::ate);
+    if (!in) throw invalid_argument("Couldn't open " + file_name + ".");
 
-    return false;
+    string source(static_cast<size_t>(in.tellg()), '\0');
+    in.seekg(0);
+    in.read(source.data(), source.size());
+    if (!in) throw invalid_argument("Couldn't read " + file_name + ".");
+
+    load_source(source);
+}
+
+void parser::load_source(string_view source) {
+    lock_guard<mutex> lock(pimpl->gram_mtx);
+    impl::loader(*pimpl, source).load();
+}
+
+namespace internal_parser {
+
+// Results are formatted into a buffer this large before going out
+constexpr size_t output_chunk = 1 << 20;
+
+// Appends n as count little-endian bytes
+inline void append_le(string& out, std::uint64_t n, size_t count) {
+    for (size_t i = 0; i < count; i++) out.push_back(static_cast<char>(n >> 8 * i & 0xff));
+}
+
+} // End of namespace internal_parser
+
+void parser::parse_file(const string& name, const string& file_name, parse_engine engine) {
+    parse_file(name, file_name, [](string_view chunk) { std::cout.write(chunk.data(), chunk.size()); }, engine);
+    std::cout.flush();
 }
 
-} // End of internal_parser
+void parser::parse_file(
+    const string& name, const string& file_name,
+    const std::function<void(string_view)>& sink, parse_engine engine
+) {
+    const auto compiled = pimpl->get_compiled_if_exists(name, engine);
+    const impl::mapped_file file(file_name);
+    file.advise_sequential();
+
+    string out;
+    out.reserve(internal_parser::output_chunk + name.size() + 64);
+    pimpl->parse_lines(*compiled, file.view(), engine,
+        [&](const vector<string_view>& lines, const vector<std::uint64_t>& bits) {
+            for (size_t i = 0; i < lines.size(); i++) {
+                out += name;
+                out += bits[i / 64] >> i % 64 & 1 ? " accepts " : " rejects ";
+                out += lines[i];
+                out += '\n';
+
+                if (out.size() >= internal_parser::output_chunk) {
+                    sink(out);
+                    out.clear();
+                }
+            }
+        }
+    );
 
-bool parser::parse(const string& name, const string& text) {
-    const auto& norm_form = pimpl->get_norm_if_exists(name);
-    return internal_parser::derives()(norm_form, text);
+    if (!out.empty()) sink(out);
 }
 
-void parser::parse_file(const string& name, const string& file_name) {
-    std::ifstream text_list("file_name");
+size_t parser::parse_file_to(
+    const string& name, const string& file_name, const string& result_file_name, parse_engine engine
+) {
+    const auto compiled = pimpl->get_compiled_if_exists(name, engine);
+    const impl::mapped_file file(file_name);
+    file.advise_sequential();
+
+    std::ofstream result(result_file_name, std::ios::binary | std::ios::trunc);
+    if (!result) throw invalid_argument("Couldn't open " + result_file_name + ".");
+
+    // The count goes first, so it's patched in once known
+    string out;
+    internal_parser::append_le(out, 0, 8);
+
+    size_t num_lines = 0;
+    pimpl->parse_lines(*compiled, file.view(), engine,
+        [&](const vector<string_view>& lines, const vector<std::uint64_t>& bits) {
+            // Every batch but the last is a whole number of words
+            for (size_t w = 0; w < bits.size(); w++) {
+                const size_t left = lines.size() - 64 * w;
+                internal_parser::append_le(out, bits[w], left >= 64 ? 8 : (left + 7) / 8);
+            }
 
-    if (!text_list) {
-        throw invalid_argument("Could'nt open file.");
-    }
+            num_lines += lines.size();
+            if (out.size() >= internal_parser::output_chunk) {
+                result.write(out.data(), out.size());
+                out.clear();
+            }
+        }
+    );
 
-    string text;
-    while (std::getline(text_list, text)) {
-        std::cout << name
-                  << (parse(name, text) ? " accepts " : " rejects ")
-                  << text << '\n';
-    }
-}
\ No newline at end of file
+    result.write(out.data(), out.size());
+    string count;
+    internal_parser::append_le(count, num_lines, 8);
+    result.seekp(0);
+    result.write(count.data(), count.size());
+
+    result.close();
+    if (!result) throw invalid_argument("Couldn't write " + result_file_name + ".");
+    return num_lines;
+}
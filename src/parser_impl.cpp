@@ -1,32 +1,45 @@
 #include "parser_impl.hpp"
 #include "parser_impl_normalizer.hpp"
+#include "parser_impl_top_down.hpp"
+#include "parser_impl_cyk.hpp"
+#include "parser_impl_earley.hpp"
+#include "parser_impl_thread_pool.hpp"
+#include "parser_impl_background_compiler.hpp"
 
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <iterator>
-#include <iostream>
+#include <cstdint>
+#include <cstring>
 
-using std::string;
+using std::string_view;
 using std::cout;
 using std::endl;
 
 using std::unordered_set;
 using std::unordered_map;
+using std::vector;
 using std::string;
 using std::pair;
 using std::invalid_argument;
 
 using namespace cfg_parser;
 
+parser::impl::~impl() {
+    compiler.reset();
+}
+
 bool parser::impl::
 is_foreign(const nonterminal nont) const {
     return !name_map.count(nont);
@@ -43,6 +56,20 @@ throw_if_has_foreign(const prod_rule& rule) const {
     )) throw invalid_argument("Grammar can't have foreign nonterminals.");
 }
 
+parser::impl::gram_family& parser::impl::
+create_family(const string& name) {
+    if (name.empty())
+        throw invalid_argument("Name can't be empty.");
+
+    const auto [it, inserted] = gram_map.emplace(name, this);
+    if (!inserted)
+        throw invalid_argument(name + " already exists.");
+
+    name_map.emplace(nonterminal(it->second.gram), name);
+    name_map_for_norm.emplace(nonterminal(it->second.norm_form), name);
+    return it->second;
+}
+
 grammar& parser::impl::
 get_if_exists(const string& name) {
     const auto it = gram_map.find(name);
@@ -61,8 +88,240 @@ get_norm_if_exists(const string& name) {
     return it->second.normalized_form();
 }
 
+parser::impl::gram_family& parser::impl::
+get_family_if_exists(const string& name) {
+    const auto it = gram_map.find(name);
+    if (it == gram_map.end())
+        throw invalid_argument(name + " doesn't exist.");
+
+    return it->second;
+}
+
+std::shared_ptr<const compiled_grammar> parser::impl::
+get_compiled_if_exists(const string& name, parse_engine engine) {
+    auto& gram_fam = get_family_if_exists(name);
+    if (engine == parse_engine::earley)
+        return gram_fam.compiled_raw_form();
+
+    return gram_fam.compiled_form();
+}
+
+void parser::impl::
+publish_edit(const grammar& edited) {
+    version++;
+
+    // Nonts whose copies the edit makes stale: edited and those mentioning any of them
+    unordered_set<nonterminal> affected;
+    if (norm.norm_copies.count(nonterminal(edited))) {
+        norm.dirty.insert(nonterminal(edited));
+        vector<nonterminal> to_visit = { nonterminal(edited) };
+        affected.insert(nonterminal(edited));
+        while (!to_visit.empty()) {
+            const auto nont = to_visit.back();
+            to_visit.pop_back();
+
+            const auto it = norm.mentioned_by.find(nont);
+            if (it == norm.mentioned_by.end()) continue;
+            for (const auto prev : it->second) {
+                if (affected.insert(prev).second) to_visit.push_back(prev);
+            }
+        }
+    }
+
+    for (const auto gram_fam_ptr : live_families) {
+        auto& gram_fam = *gram_fam_ptr;
+        // Families that never normalized edited can't have it in their normalized form
+        const bool norm_affected = affected.count(nonterminal(gram_fam.gram));
+        if (norm_affected) gram_fam.norm_form_valid = false;
+
+        // Families nobody has compiled yet are left for their first parse
+        if (norm_affected && std::atomic_load(&gram_fam.compiled)) gram_fam.compiled_stale = true;
+        if (std::atomic_load(&gram_fam.compiled_raw) && edited.reachable_from(nonterminal(gram_fam.gram)))
+            gram_fam.compiled_raw_stale = true;
+
+        if (!gram_fam.compiled_stale && !gram_fam.compiled_raw_stale) continue;
+        if (background_compile) get_compiler().schedule(gram_fam);
+        else gram_fam.drop_stale();
+    }
+}
+
+nonterminal parser::impl::
+acquire_singleton(const string& term_str) {
+    const auto it = singleton_map.find(term_str);
+    if (it != singleton_map.end()) {
+        it->second.num_refs++;
+        return nonterminal(it->second.gram);
+    }
+
+    // A single terminal, or the singleton of all but the last terminal followed by that of the last
+    prod_rule rule = { terminal(term_str.front()) };
+    if (term_str.size() > 1) {
+        rule = {
+            acquire_singleton(term_str.substr(0, term_str.size() - 1)),
+            acquire_singleton(string(1, term_str.back()))
+        };
+    }
+
+    auto& single = singleton_map.try_emplace(
+        term_str, std::initializer_list<prod_rule>{ rule }
+    ).first->second;
+
+    single.num_refs = 1;
+    name_map_for_norm.emplace(nonterminal(single.gram), term_str);
+    return nonterminal(single.gram);
+}
+
+void parser::impl::
+release_singleton(const string& term_str) {
+    const auto it = singleton_map.find(term_str);
+    if (--it->second.num_refs > 0) return;
+
+    name_map_for_norm.erase(nonterminal(it->second.gram));
+    singleton_map.erase(it);
+
+    if (term_str.size() > 1) {
+        release_singleton(term_str.substr(0, term_str.size() - 1));
+        release_singleton(string(1, term_str.back()));
+    }
+}
+
+std::shared_ptr<parser::impl::thread_pool> parser::impl::
+get_pool() {
+    std::lock_guard<std::mutex> lock(pool_mtx);
+    if (!pool) pool = std::make_shared<thread_pool>(num_threads);
+    return pool;
+}
+
+parser::impl::background_compiler& parser::impl::
+get_compiler() {
+    std::lock_guard<std::mutex> lock(compiler_mtx);
+    if (!compiler) compiler = std::make_unique<background_compiler>(this);
+    return *compiler;
+}
+
+template <typename engine>
+vector<std::uint64_t> parser::impl::
+parse_bits_with(const compiled_grammar& gram, const vector<string_view>& words) {
+    // Every task owns one word of the result bitmap
+    constexpr size_t chunk = 64;
+    const size_t num_chunks = (words.size() + chunk - 1) / chunk;
+    vector<std::uint64_t> bitmap(num_chunks, 0);
+
+    const auto workers = get_pool();
+    vector<std::unique_ptr<engine>> engines(workers->size());
+
+    workers->run(num_chunks,
+        [&](size_t task, size_t worker) {
+            auto& eng = engines[worker];
+            if (!eng) eng = std::make_unique<engine>(gram);
+
+            std::uint64_t bits = 0;
+            const size_t beg = task * chunk;
+            const size_t end = std::min(words.size(), beg + chunk);
+            for (size_t i = beg; i < end; i++) {
+                if ((*eng)(words[i])) bits |= std::uint64_t(1) << (i - beg);
+            }
+
+            bitmap[task] = bits;
+        }
+    );
+
+    return bitmap;
+}
+
+vector<std::uint64_t> parser::impl::
+parse_bits(const compiled_grammar& gram, const vector<string_view>& words, parse_engine engine) {
+    switch (engine) {
+    case parse_engine::top_down:
+        return parse_bits_with<top_down>(gram, words);
+    case parse_engine::cyk:
+        return parse_bits_with<cyk>(gram, words);
+    case parse_engine::earley:
+        return parse_bits_with<earley>(gram, words);
+    }
+
+    throw invalid_argument("Unknown parse engine.");
+}
+
+vector<bool> parser::impl::
+parse_batch(const compiled_grammar& gram, const vector<string_view>& words, parse_engine engine) {
+    const auto bitmap = parse_bits(gram, words, engine);
+
+    vector<bool> result(words.size());
+    for (size_t i = 0; i < words.size(); i++) {
+        result[i] = bitmap[i / 64] >> i % 64 & 1;
+    }
+
+    return result;
+}
+
+void parser::impl::
+parse_lines(
+    const compiled_grammar& gram, string_view text, parse_engine engine, const line_batch_handler& on_batch
+) {
+    vector<string_view> lines;
+    lines.reserve(std::min(lines_per_batch, text.size() / 16 + 1));
+
+    const char* pos = text.data();
+    const char* const end = pos + text.size();
+    while (pos != end) {
+        // memchr scans a vector register at a time, and the views copy nothing
+        const auto eol = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        const char* const line_end = eol ? eol : end;
+
+        size_t length = line_end - pos;
+        if (length && pos[length - 1] == '\r') length--;
+        lines.emplace_back(pos, length);
+        pos = eol ? eol + 1 : end;
+
+        if (lines.size() == lines_per_batch) {
+            on_batch(lines, parse_bits(gram, lines, engine));
+            lines.clear();
+        }
+    }
+
+    if (!lines.empty()) on_batch(lines, parse_bits(gram, lines, engine));
+}
+
+size_t parser::impl::norm_cache::
+nont_pair_hash::operator()(const nont_pair& p) const {
+    // Combined asymmetrically, so (B, C) and (C, B) don't collide
+    const size_t seed = std::hash<nonterminal>()(p.first);
+    return seed ^ (std::hash<nonterminal>()(p.second) + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
+parser::impl::norm_cache::useless_count parser::impl::norm_cache::
+useless_from(const grammar& gram) const {
+    useless_count useless;
+    unordered_set<nonterminal> pairs_seen;
+    const auto add_pair = [&](nonterminal nont, const auto& add_pair) -> void {
+        const auto key_it = pair_keys.find(nont);
+        if (key_it == pair_keys.end() || !pairs_seen.insert(nont).second) return;
+
+        const auto& pair_useless = pair_grams.at(key_it->second).useless;
+        useless.nonts += pair_useless.nonts;
+        useless.rules += pair_useless.rules;
+        add_pair(key_it->second.first,  add_pair);
+        add_pair(key_it->second.second, add_pair);
+    };
+
+    gram.dfs(
+        [&](nonterminal nont) {
+            const auto it = norm_copies.find(nont);
+            if (it == norm_copies.end()) return;
+
+            useless.nonts += it->second.useless.nonts;
+            useless.rules += it->second.useless.rules;
+            for (const auto pair_nont : it->second.pairs) add_pair(pair_nont, add_pair);
+        }
+    );
+
+    return useless;
+}
+
 const grammar& parser::impl::gram_family::normalized_form() {
     if (!norm_form_valid) {
+        pimpl->live_families.insert(this);
         norm_form.clear();
         normalizer nzer(*this);
         nzer.normalize();
@@ -72,6 +331,76 @@ const grammar& parser::impl::gram_family::normalized_form() {
     return norm_form;
 }
 
+std::shared_ptr<const compiled_grammar> parser::impl::gram_family::compiled_form() {
+    auto snapshot = std::atomic_load(&compiled);
+    if (snapshot) return snapshot;
+
+    std::lock_guard<std::mutex> lock(pimpl->gram_mtx);
+    snapshot = std::atomic_load(&compiled);
+    if (snapshot) return snapshot; // Compiled while waiting for the lock
+
+    return recompile();
+}
+
+std::shared_ptr<const compiled_grammar> parser::impl::gram_family::compiled_raw_form() {
+    auto snapshot = std::atomic_load(&compiled_raw);
+    if (snapshot) return snapshot;
+
+    std::lock_guard<std::mutex> lock(pimpl->gram_mtx);
+    snapshot = std::atomic_load(&compiled_raw);
+    if (snapshot) return snapshot; // Compiled while waiting for the lock
+
+    return recompile_raw();
+}
+
+std::shared_ptr<const compiled_grammar> parser::impl::gram_family::recompile() {
+    const auto& norm = normalized_form();
+    const auto useless = pimpl->norm.useless_from(gram);
+    std::shared_ptr<const compiled_grammar> snapshot(
+        new compiled_grammar(gram, norm, pimpl->name_map, pimpl->version, useless.nonts, useless.rules)
+    );
+
+    std::atomic_store(&compiled, snapshot);
+    compiled_stale = false;
+    return snapshot;
+}
+
+std::shared_ptr<const compiled_grammar> parser::impl::gram_family::recompile_raw() {
+    pimpl->live_families.insert(this);
+    std::shared_ptr<const compiled_grammar> snapshot(
+        new compiled_grammar(gram, pimpl->name_map, pimpl->version)
+    );
+
+    std::atomic_store(&compiled_raw, snapshot);
+    compiled_raw_stale = false;
+    return snapshot;
+}
+
+std::shared_ptr<const compiled_grammar> parser::impl::gram_family::up_to_date_form() {
+    auto snapshot = std::atomic_load(&compiled);
+    if (snapshot && !compiled_stale) return snapshot;
+    return recompile();
+}
+
+void parser::impl::gram_family::drop_stale() {
+    if (compiled_stale)     std::atomic_store(&compiled,     std::shared_ptr<const compiled_grammar>());
+    if (compiled_raw_stale) std::atomic_store(&compiled_raw, std::shared_ptr<const compiled_grammar>());
+    compiled_stale = compiled_raw_stale = false;
+}
+
+void parser::impl::gram_family::refresh() {
+    try {
+        if (compiled_stale)     recompile();
+        if (compiled_raw_stale) recompile_raw();
+    } catch (const empty_nont_error&) {
+        /* The edit left the family without a normal form (e.g. an empty
+        nont). That's fine mid-edit, so its next parse reports it instead. */
+        std::atomic_store(&compiled,     std::shared_ptr<const compiled_grammar>());
+        std::atomic_store(&compiled_raw, std::shared_ptr<const compiled_grammar>());
+        compiled_stale = compiled_raw_stale = false;
+    }
+}
+
 bool parser::impl::greater_than(const symbol& lhs, const symbol& rhs) {
     if (lhs.is_term()) {
         if (rhs.is_nont())
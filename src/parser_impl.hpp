@@ -3,7 +3,15 @@
 #include "cfg_parser.hpp"
 
 #include <utility>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <string_view>
+#include <stdexcept>
 #include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
 #include <initializer_list>
 
 namespace cfg_parser {
@@ -13,17 +21,152 @@ class parser::impl {
 public:    
     struct gram_family;
     class normalizer;
+    class top_down;
+    class cyk;
+    class earley;
+    class thread_pool;
+    class background_compiler;
+    class loader;
+    class mapped_file;
+
+    // Thrown when normalizing a family that reaches an empty nont, which is fine mid-edit
+    struct empty_nont_error : std::logic_error {
+        using std::logic_error::logic_error;
+    };
 
     std::unordered_map<std::string, gram_family> gram_map;
     std::unordered_map<nonterminal, std::string> name_map;
     std::unordered_map<nonterminal, std::string> name_map_for_norm;
-    std::unordered_map<std::string, const grammar> singleton_map;
-    
+
+    // Chains of nonts deriving exactly one string of terminals, shared by every family
+    struct singleton {
+        const grammar gram;
+        size_t num_refs = 0; // Families using it, plus longer singletons built on it
+
+        singleton(std::initializer_list<prod_rule> rules) : gram(rules) {}
+    };
+
+    std::unordered_map<std::string, singleton> singleton_map;
+
+    /* Normalized copies of the nonts reachable from the families normalized
+    so far, with the pieces binarizing them. Shared by every family, so a
+    nont reachable from many is copied and normalized once, and renormalized
+    only when an edit can affect it. Written under gram_mtx. */
+    struct norm_cache {
+        // Pruned from a copy or pair for deriving no word
+        struct useless_count {
+            size_t nonts = 0;
+            size_t rules = 0;
+        };
+
+        struct norm_copy {
+            std::unique_ptr<grammar> gram;
+            std::vector<nonterminal> pairs;    // Acquired from pair_grams for its rules
+            std::vector<nonterminal> mentions; // Nonts in the rules it was copied from
+            useless_count useless;
+        };
+
+        /* Nonts { B C } introduced while binarizing, shared by every rule
+        with the same span, and freed once no rule or pair uses them */
+        using  nont_pair = std::pair<nonterminal, nonterminal>;
+        struct nont_pair_hash { size_t operator()(const nont_pair&) const; };
+        struct shared_pair {
+            std::unique_ptr<grammar> gram;
+            size_t num_refs = 0; // Rules of copies using it, plus larger pairs built on it
+            useless_count useless;
+        };
+
+        std::unordered_map<nonterminal, norm_copy> norm_copies;
+        std::unordered_map<nont_pair, shared_pair, nont_pair_hash> pair_grams;
+        std::unordered_map<nonterminal, nont_pair> pair_keys; // of pair_grams, by their nont
+        std::unordered_map<nonterminal, std::unordered_set<nonterminal>> mentioned_by; // Reverse of mentions
+        std::unordered_set<nonterminal> nullable; // Copies and pairs deriving the empty word
+        std::unordered_set<nonterminal> dirty;    // Nonts edited since the last normalization
+        std::unordered_set<nonterminal> empty;    // Nonts with a copy but no rules, as of their last normalization
+        size_t num_norm_names = 0; // Names given out to copies and pairs in name_map_for_norm
+
+        std::unordered_set<std::string> singletons; // Acquired from singleton_map
+        size_t num_renormalized = 0; // Copies refilled since unreachable ones were last reclaimed
+
+        // Summed over the copies of the nonts reachable from gram, and their pairs
+        useless_count useless_from(const grammar& gram) const;
+    };
+
+    norm_cache norm;
+
+    /* Held while editing, normalizing or compiling the grammars,
+    and while writing singleton_map and name_map_for_norm.
+    Parses only take it to compile a family for the first time. */
+    std::mutex gram_mtx;
+    std::uint64_t version = 0; // Bumped on every edit
+    binarization bin = binarization::prefix_sharing;
+
+    // Families normalized or compiled at least once, which edits must keep up to date
+    std::unordered_set<gram_family*> live_families;
+
+    /* Both under pool_mtx. Users hold their own reference to the pool,
+    so set_num_threads can swap it while a batch still runs on the old one. */
+    size_t num_threads = 0;
+    std::shared_ptr<thread_pool> pool; // Created on first use
+    std::mutex pool_mtx;
+
+    // Whether edits leave recompiling the families they affect to compiler
+    bool background_compile = false;
+    std::unique_ptr<background_compiler> compiler; // Created on first use
+    std::mutex compiler_mtx;
+
+   ~impl(); // Stops compiler first, as its jobs use the rest
+
     bool is_foreign(const nonterminal) const;
     void throw_if_has_foreign(const prod_rule&) const;
 
+    // Throws if name is empty or taken, the caller must hold gram_mtx
+    gram_family& create_family(const std::string& name);
+
     grammar& get_if_exists(const std::string& name);
-    const grammar& get_norm_if_exists(const std::string& name);
+    const grammar& get_norm_if_exists(const std::string& name); // The caller must hold gram_mtx
+    gram_family& get_family_if_exists(const std::string& name);
+    std::shared_ptr<const compiled_grammar> get_compiled_if_exists(const std::string& name, parse_engine);
+
+    /* Called under gram_mtx once edited has changed. Marks the copies it
+    affects stale and swaps in fresh snapshots for every compiled family
+    that can reach edited, while parses keep using the ones they already hold.
+    With background_compile, those families are queued on compiler instead. */
+    void publish_edit(const grammar& edited);
+
+    /* Each acquire of a singleton must be matched by one release, which frees
+    it once unused. The caller must hold gram_mtx. */
+    nonterminal acquire_singleton(const std::string& term_str);
+    void release_singleton(const std::string& term_str);
+
+    std::shared_ptr<thread_pool> get_pool();
+    background_compiler& get_compiler();
+
+    // Fans words out over the pool, each worker reusing its own engine
+    std::vector<bool> parse_batch(
+        const compiled_grammar&,
+        const std::vector<std::string_view>& words,
+        parse_engine
+    );
+
+    // Same, but whether words[i] is accepted is bit i % 64 of word i / 64
+    std::vector<std::uint64_t> parse_bits(
+        const compiled_grammar&,
+        const std::vector<std::string_view>& words,
+        parse_engine
+    );
+
+    using line_batch_handler = std::function<
+        void(const std::vector<std::string_view>& lines, const std::vector<std::uint64_t>& bits)
+    >;
+
+    /* Splits text into lines without their line breaks, a last one without
+    any included, and parses them lines_per_batch at a time. Each batch is
+    handed over with its parse_bits in order, and only lives until then. */
+    static constexpr size_t lines_per_batch = 1 << 16;
+    void parse_lines(
+        const compiled_grammar&, std::string_view text, parse_engine, const line_batch_handler&
+    );
 
     // Prints rules of the nont
     void print_shallow(nonterminal);
@@ -32,6 +175,12 @@ public:
     void print_shallow_for_norm(nonterminal);
 
 private:
+    template <typename engine>
+    std::vector<std::uint64_t> parse_bits_with(
+        const compiled_grammar&,
+        const std::vector<std::string_view>& words
+    );
+
     // __Helpers for print_shallow and print_shallow_for_norm__
 
     static bool greater_than(const symbol&, const symbol&);
@@ -47,15 +196,45 @@ struct parser::impl::gram_family {
     grammar gram;
     grammar norm_form;
     bool    norm_form_valid = false;
-    std::vector<std::unique_ptr<grammar>> owned_grams; // excluding norm_form itself
-    
+
+    /* Snapshots swapped atomically, so parses load them without locking.
+    A replaced snapshot is freed once the last parse holding it is done. */
+    std::shared_ptr<const compiled_grammar> compiled;     // of gram and norm_form
+    std::shared_ptr<const compiled_grammar> compiled_raw; // of gram alone, for Earley
+
+    /* Snapshots older than gram, still served until they're recompiled in the
+    background. Written under pimpl->gram_mtx, like compile_queued. */
+    bool compiled_stale     = false;
+    bool compiled_raw_stale = false;
+    bool compile_queued     = false; // on pimpl->compiler
+
     impl* pimpl;
 
     gram_family(impl* pimpl) : pimpl(pimpl) {}
     gram_family(const gram_family&) = delete;
     gram_family(gram_family&&)      = delete;
 
+    // The caller must hold pimpl->gram_mtx
     const grammar& normalized_form();
+
+    // Safe to call from many threads at once
+    std::shared_ptr<const compiled_grammar> compiled_form();
+    std::shared_ptr<const compiled_grammar> compiled_raw_form();
+
+    // Build and swap in a snapshot of the current version, the caller must hold pimpl->gram_mtx
+    std::shared_ptr<const compiled_grammar> recompile();
+    std::shared_ptr<const compiled_grammar> recompile_raw();
+
+    // Snapshot of gram as it is now, the caller must hold pimpl->gram_mtx
+    std::shared_ptr<const compiled_grammar> up_to_date_form();
+
+    /* Recompiles the stale snapshots, or drops both if gram has no normal form
+    any more, leaving the next parse to report it. The caller must hold pimpl->gram_mtx. */
+    void refresh();
+
+    /* Drops the stale snapshots instead, so edits stay cheap and the next
+    parse compiles gram as it is then. The caller must hold pimpl->gram_mtx. */
+    void drop_stale();
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "parser_impl_background_compiler.hpp"
+
+#include <stdexcept>
+
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+
+using namespace cfg_parser;
+
+parser::impl::background_compiler::
+background_compiler(impl* pimpl) : pimpl(pimpl) {
+    worker = std::thread([this] { work(); });
+}
+
+parser::impl::background_compiler::
+~background_compiler() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+
+    work_cv.notify_all();
+    worker.join();
+}
+
+std::future<parser::impl::background_compiler::snapshot> parser::impl::background_compiler::
+submit(gram_family& gram_fam) {
+    auto result = std::make_unique<std::promise<snapshot>>();
+    auto future = result->get_future();
+    {
+        lock_guard<mutex> lock(mtx);
+        jobs.push_back({ &gram_fam, std::move(result) });
+    }
+
+    work_cv.notify_one();
+    return future;
+}
+
+void parser::impl::background_compiler::
+schedule(gram_family& gram_fam) {
+    // Already queued, and the job will see every edit made until it runs
+    if (gram_fam.compile_queued) return;
+    gram_fam.compile_queued = true;
+
+    {
+        lock_guard<mutex> lock(mtx);
+        jobs.push_back({ &gram_fam, nullptr });
+    }
+
+    work_cv.notify_one();
+}
+
+void parser::impl::background_compiler::
+work() {
+    while (true) {
+        job next;
+        {
+            unique_lock<mutex> lock(mtx);
+            work_cv.wait(lock, [&] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+
+            next = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        lock_guard<mutex> gram_lock(pimpl->gram_mtx);
+        auto& gram_fam = *next.gram_fam;
+        if (!next.result) {
+            gram_fam.compile_queued = false;
+            try {
+                gram_fam.refresh();
+            } catch (...) {
+                // Nobody waits on it: the family stays stale, so its next parse recompiles and throws
+            }
+
+            continue;
+        }
+
+        try {
+            next.result->set_value(gram_fam.up_to_date_form());
+        } catch (...) {
+            next.result->set_exception(std::current_exception());
+        }
+    }
+}
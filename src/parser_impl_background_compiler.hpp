@@ -0,0 +1,49 @@
+#pragma once
+
+#include "parser_impl.hpp"
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <memory>
+
+namespace cfg_parser {
+
+/* A single thread compiling families off the calling threads, one job at a
+time under gram_mtx. Parses keep loading the snapshots already published
+while it works, and pick up each new one once it's swapped in. */
+class parser::impl::background_compiler {
+
+public:
+    using snapshot = std::shared_ptr<const compiled_grammar>;
+
+    explicit background_compiler(impl* pimpl);
+    background_compiler(const background_compiler&) = delete;
+   ~background_compiler(); // Jobs still queued are dropped, breaking their promises
+
+    // Brings the snapshot of gram_fam up to date, then fulfils the future with it
+    std::future<snapshot> submit(gram_family&);
+
+    // Brings the stale snapshots of gram_fam up to date, the caller must hold gram_mtx
+    void schedule(gram_family&);
+
+private:
+    struct job {
+        gram_family* gram_fam;
+        std::unique_ptr<std::promise<snapshot>> result; // Null for jobs queued by edits
+    };
+
+    impl* pimpl;
+    std::thread worker;
+
+    std::mutex mtx;
+    std::condition_variable work_cv;
+    std::deque<job> jobs;
+    bool stopping = false;
+
+    void work();
+};
+
+}
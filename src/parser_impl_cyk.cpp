@@ -0,0 +1,102 @@
+#include "parser_impl_cyk.hpp"
+
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+using std::vector;
+using std::string_view;
+
+using namespace cfg_parser;
+
+namespace internal_parser_cyk {
+
+inline size_t lowest_bit(std::uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    size_t index = 0;
+    while (!(bits & 1)) { bits >>= 1; index++; }
+    return index;
+#endif
+}
+
+} // End of namespace internal_parser_cyk
+
+parser::impl::cyk::
+cyk(const compiled_grammar& gram) : tables(*gram.pimpl) {}
+
+void parser::impl::cyk::
+combine(const word* left, const word* right, word* out) const {
+    using namespace internal_parser_cyk;
+
+    // As out could alias the tables otherwise, each is read into a register once
+    const auto* const right_begin = tables.right_begin.begin();
+    const auto* const rights      = tables.rights.begin();
+    const auto* const head_begin  = tables.head_begin.begin();
+    const auto* const heads       = tables.heads.begin();
+
+    const size_t num_words = tables.num_words;
+    for (size_t w = 0; w < num_words; w++) {
+        for (word bits = left[w]; bits != 0; bits &= bits - 1) {
+            const size_t left_id = w * word_bits + lowest_bit(bits);
+            for (size_t i = right_begin[left_id]; i < right_begin[left_id + 1]; i++) {
+                const word pair_rights = rights[i].bits;
+                word hits = right[rights[i].index] & pair_rights;
+                if (!hits) continue;
+
+                const auto add_heads = [&](size_t p) {
+                    for (size_t h = head_begin[p]; h < head_begin[p + 1]; h++) {
+                        out[heads[h].index] |= heads[h].bits;
+                    }
+                };
+
+                // Most words hold a single right
+                size_t p = rights[i].first_pair;
+                if (!(pair_rights & (pair_rights - 1))) {
+                    add_heads(p);
+                    continue;
+                }
+
+                // Pairs are numbered in the order of their bits, counted up to the last hit
+                for (word rest = pair_rights; hits != 0; rest &= rest - 1, p++) {
+                    const word low = rest & -rest;
+                    if (!(hits & low)) continue;
+
+                    hits ^= low;
+                    add_heads(p);
+                }
+            }
+        }
+    }
+}
+
+bool parser::impl::cyk::
+operator()(string_view text) {
+    const size_t n = text.size();
+    const size_t num_words = tables.num_words;
+    if (n == 0) return tables.accepts_empty;
+
+    row_offset.assign(n + 1, 0);
+    for (size_t len = 1; len < n; len++) {
+        row_offset[len + 1] = row_offset[len] + (n - len + 1);
+    }
+
+    chart.assign((row_offset[n] + 1) * num_words, 0);
+
+    for (size_t beg = 0; beg < n; beg++) {
+        const auto ch = static_cast<unsigned char>(text[beg]);
+        std::copy_n(&tables.term_nonts[ch * num_words], num_words, cell(beg, 1));
+    }
+
+    for (size_t len = 2; len <= n; len++) {
+        for (size_t beg = 0; beg + len <= n; beg++) {
+            word* out = cell(beg, len);
+            for (size_t left_len = 1; left_len < len; left_len++) {
+                combine(cell(beg, left_len), cell(beg + left_len, len - left_len), out);
+            }
+        }
+    }
+
+    return cell(0, n)[0] & 1; // The norm_form has id 0
+}
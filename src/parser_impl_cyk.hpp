@@ -0,0 +1,36 @@
+#pragma once
+
+#include "parser_impl.hpp"
+#include "compiled_grammar_impl.hpp"
+
+#include <string_view>
+#include <vector>
+
+namespace cfg_parser {
+
+/* Bottom-up CYK recognizer over the normalized form of a compiled
+grammar. Every chart cell is a bitset of nont ids, so combining
+two cells is word-wide AND/OR against the reverse pair index. */
+class parser::impl::cyk {
+
+public:
+    cyk(const compiled_grammar& gram);
+
+    bool operator()(std::string_view text);
+
+private:
+    using word = compiled_grammar::impl::word;
+    static constexpr size_t word_bits = compiled_grammar::impl::word_bits;
+
+    const compiled_grammar::impl& tables;
+
+    // Cell (beg, len) is the bitset of nonts deriving text.substr(beg, len)
+    std::vector<word>   chart;
+    std::vector<size_t> row_offset;
+
+    word* cell(size_t beg, size_t len) { return &chart[(row_offset[len] + beg) * tables.num_words]; }
+
+    void combine(const word* left, const word* right, word* out) const;
+};
+
+}
@@ -0,0 +1,89 @@
+#include "parser_impl_earley.hpp"
+
+#include <string_view>
+#include <vector>
+
+using std::string_view;
+
+using namespace cfg_parser;
+
+parser::impl::earley::
+earley(const compiled_grammar& gram) : tables(*gram.pimpl) {}
+
+void parser::impl::earley::
+add(item it) {
+    const std::uint64_t key = std::uint64_t(it.pos) << 32 | it.origin;
+    if (in_set.insert(key).second) items.push_back(it);
+}
+
+bool parser::impl::earley::
+operator()(string_view text) {
+    const size_t n = text.size();
+    const auto& symbols    = tables.symbols;
+    const auto& rule_begin = tables.rule_begin;
+    const auto& nont_rules = tables.nont_rules;
+    const size_t num_nonts = nont_rules.size() - 1;
+
+    items.clear();
+    scanned.clear();
+    set_begin.assign(1, 0);
+
+    for (size_t i = 0; i <= n; i++) {
+        in_set.clear();
+        predicted.assign(num_nonts, false);
+
+        if (i == 0) {
+            predicted[0] = true; // The grammar itself has id 0
+            for (size_t r = nont_rules[0]; r < nont_rules[1]; r++) {
+                add({ static_cast<std::uint32_t>(rule_begin[r]), 0 });
+            }
+        } else {
+            if (scanned.empty()) return false;
+            for (const auto it : scanned) add(it);
+            scanned.clear();
+        }
+
+        for (size_t k = set_begin[i]; k < items.size(); k++) {
+            const item curr = items[k]; // add may reallocate items
+            const code symb = symbols[curr.pos];
+
+            if (tables.is_end(symb)) {
+                /* Completions of a nont with origin i are already done by
+                advancing over nullable nonts when predicting them */
+                if (curr.origin == i) continue;
+
+                const code lhs = symb & ~tables.end_flag;
+                for (size_t j = set_begin[curr.origin]; j < set_begin[curr.origin + 1]; j++) {
+                    if (symbols[items[j].pos] == lhs)
+                        add({ items[j].pos + 1, items[j].origin });
+                }
+
+                continue;
+            }
+
+            if (tables.is_term(symb)) {
+                if (i < n && (symb & ~tables.term_flag) == static_cast<unsigned char>(text[i]))
+                    scanned.push_back({ curr.pos + 1, curr.origin });
+
+                continue;
+            }
+
+            if (!predicted[symb]) {
+                predicted[symb] = true;
+                for (size_t r = nont_rules[symb]; r < nont_rules[symb + 1]; r++) {
+                    add({ static_cast<std::uint32_t>(rule_begin[r]), static_cast<std::uint32_t>(i) });
+                }
+            }
+
+            if (tables.nullable[symb]) add({ curr.pos + 1, curr.origin });
+        }
+
+        set_begin.push_back(items.size());
+    }
+
+    for (size_t k = set_begin[n]; k < set_begin[n + 1]; k++) {
+        if (items[k].origin == 0 && symbols[items[k].pos] == tables.end_flag) return true;
+    }
+
+    return false;
+}
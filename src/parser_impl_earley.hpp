@@ -0,0 +1,40 @@
+#pragma once
+
+#include "parser_impl.hpp"
+#include "compiled_grammar_impl.hpp"
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <unordered_set>
+
+namespace cfg_parser {
+
+/* Earley recognizer over a compiled grammar as the user wrote it,
+so no normalization is needed. Every item is a (position in the
+flattened symbol array, origin) pair. */
+class parser::impl::earley {
+
+public:
+    earley(const compiled_grammar& gram);
+
+    bool operator()(std::string_view text);
+
+private:
+    using code = compiled_grammar::impl::code;
+
+    const compiled_grammar::impl& tables;
+
+    struct item { std::uint32_t pos; std::uint32_t origin; };
+
+    // Set i is items[set_begin[i], set_begin[i + 1])
+    std::vector<item>   items;
+    std::vector<size_t> set_begin;
+    std::vector<item>   scanned; // Items of the next set
+    std::vector<bool>   predicted;
+    std::unordered_set<std::uint64_t> in_set;
+
+    void add(item);
+};
+
+}
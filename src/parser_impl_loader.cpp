@@ -0,0 +1,320 @@
+#include "parser_impl_loader.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::invalid_argument;
+
+using namespace cfg_parser;
+
+void parser::impl::loader::
+load() {
+    // About a name every 16 bytes, so the ids rarely rehash
+    ids.reserve(source.size() / 16);
+    vector<vector<read_symbol>> alts;
+    while (true) {
+        skip_space();
+        if (at_end()) break;
+
+        const size_t at = pos;
+        if (!is_name_start(peek())) fail("Expected the name of a rule.", at);
+        head = id_of(read_name(), at);
+        defined[head] = true;
+
+        skip_space();
+        const size_t length = definer_length();
+        if (!length) fail("Expected ::= after " + string(names[head]) + '.', pos);
+        pos += length;
+
+        alts.clear();
+        read_alternatives(alts, '\0');
+        for (const auto& alt : alts) add_rule(head, alt, 0, alt.size());
+        if (peek() == ';') pos++;
+    }
+
+    // Names neither defined here nor already in the parser
+    for (std::uint32_t id = 0; id < names.size(); id++) {
+        if (!defined[id] && !pimpl.gram_map.count(string(names[id])))
+            fail(string(names[id]) + " is never defined.", first_seen[id]);
+    }
+
+    apply();
+}
+
+void parser::impl::loader::
+fail(const string& message, size_t at) const {
+    const size_t line = 1 + std::count(source.begin(), source.begin() + at, '\n');
+    throw invalid_argument("Line " + std::to_string(line) + ": " + message);
+}
+
+// __Lexing__
+
+// Skips whitespace and comments, which run from # to the end of the line
+void parser::impl::loader::
+skip_space() {
+    while (!at_end()) {
+        const char ch = source[pos];
+        if (ch == '#') {
+            const size_t eol = source.find('\n', pos);
+            pos = eol == string_view::npos ? source.size() : eol;
+        } else if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r') {
+            pos++;
+        } else {
+            return;
+        }
+    }
+}
+
+bool parser::impl::loader::
+is_name_start(char ch) {
+    return ch == '<' || ch == '_' || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+// An identifier, or anything but a line break between angle brackets
+string_view parser::impl::loader::
+read_name() {
+    const size_t at = pos;
+    if (source[pos] == '<') {
+        const size_t close = source.find_first_of(">\n", pos);
+        if (close == string_view::npos || source[close] != '>') fail("Unterminated name.", at);
+        if (close == pos + 1) fail("Names can't be empty.", at);
+
+        pos = close + 1;
+        return source.substr(at + 1, close - at - 1);
+    }
+
+    const auto is_name_char = [](char ch) {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+               ch == '_' || ch == '.' || ch == '-';
+    };
+
+    while (!at_end() && is_name_char(source[pos])) pos++;
+    return source.substr(at, pos - at);
+}
+
+size_t parser::impl::loader::
+definer_length() const {
+    if (source.compare(pos, 3, "::=") == 0) return 3;
+    return peek() == '=' ? 1 : 0;
+}
+
+// Whether a name followed by ::= is next, which starts the next rule
+bool parser::impl::loader::
+at_rule_start() {
+    if (!is_name_start(peek())) return false;
+
+    const size_t at = pos;
+    read_name();
+    skip_space();
+    const bool starts = definer_length() != 0;
+    pos = at;
+    return starts;
+}
+
+// __Parsing__
+
+std::uint32_t parser::impl::loader::
+id_of(string_view name, size_t at) {
+    const auto [it, inserted] = ids.try_emplace(name, static_cast<std::uint32_t>(names.size()));
+    if (inserted) {
+        names.push_back(name);
+        first_seen.push_back(at);
+        defined.push_back(false);
+    }
+
+    return it->second;
+}
+
+// A fresh nont named after the rule being read, as in Expr#1
+std::uint32_t parser::impl::loader::
+new_helper() {
+    string name;
+    do {
+        name = string(names[head]) + '#' + std::to_string(++num_helpers);
+    } while (ids.count(name) || pimpl.gram_map.count(name));
+
+    helper_names.push_back(std::move(name));
+    const auto id = id_of(helper_names.back(), pos);
+    defined[id] = true;
+    return id;
+}
+
+void parser::impl::loader::
+add_rule(std::uint32_t rule_head, const vector<read_symbol>& seq, size_t beg, size_t end) {
+    // A helper deriving just itself, as from { }, derives nothing more for it
+    if (end - beg == 1 && !seq[beg].is_term && seq[beg].value == rule_head) return;
+
+    const auto begin = static_cast<std::uint32_t>(symbols.size());
+    symbols.insert(symbols.end(), seq.begin() + beg, seq.begin() + end);
+    rules.push_back({ rule_head, begin, static_cast<std::uint32_t>(symbols.size()) });
+}
+
+void parser::impl::loader::
+read_alternatives(vector<vector<read_symbol>>& alts, char closer) {
+    while (true) {
+        const size_t at = pos;
+        alts.emplace_back();
+        read_sequence(alts.back(), closer);
+
+        // Grammars reject these, so they'd only fail once the grammars are half filled
+        const auto& alt = alts.back();
+        if (!closer && alt.size() == 1 && !alt[0].is_term && alt[0].value == head)
+            fail(string(names[head]) + " can't derive just itself.", at);
+
+        if (peek() != '|') return;
+        pos++;
+    }
+}
+
+void parser::impl::loader::
+read_sequence(vector<read_symbol>& seq, char closer) {
+    while (true) {
+        skip_space();
+        const char ch = peek();
+        if (at_end() || ch == '|' || ch == ';' || (closer && ch == closer)) return;
+        if (!closer && at_rule_start()) return;
+
+        if (ch == ')' || ch == ']' || ch == '}')
+            fail(string("Unmatched ") + ch + '.', pos);
+
+        read_factor(seq);
+    }
+}
+
+void parser::impl::loader::
+read_factor(vector<read_symbol>& seq) {
+    const size_t start = seq.size();
+    const size_t at = pos;
+    const char ch = peek();
+
+    if (ch == '\'' || ch == '"') {
+        read_quoted(seq);
+    } else if (ch == '(' || ch == '[' || ch == '{') {
+        const char closer = ch == '(' ? ')' : ch == '[' ? ']' : '}';
+        pos++;
+        vector<vector<read_symbol>> alts;
+        read_alternatives(alts, closer);
+        if (peek() != closer) fail(string("Unmatched ") + ch + '.', at);
+        pos++;
+
+        if (ch == '(' && alts.size() == 1) {
+            seq.insert(seq.end(), alts[0].begin(), alts[0].end()); // Nothing to group
+        } else {
+            // A helper deriving the alternatives, or any of them followed by itself for { }
+            const auto group = new_helper();
+            for (auto& alt : alts) {
+                if (ch == '{') alt.push_back({ group, false });
+                add_rule(group, alt, 0, alt.size());
+            }
+
+            if (ch != '(') rules.push_back({ group, 0, 0 });
+            seq.push_back({ group, false });
+        }
+    } else if (is_name_start(ch)) {
+        seq.push_back({ id_of(read_name(), at), false });
+    } else {
+        fail(string("Unexpected ") + ch + '.', at);
+    }
+
+    skip_space();
+    while (peek() == '*' || peek() == '+' || peek() == '?') {
+        apply_postfix(seq, start, peek());
+        pos++;
+        skip_space();
+    }
+}
+
+// Every char between the quotes is a terminal, where \ escapes the next one
+void parser::impl::loader::
+read_quoted(vector<read_symbol>& seq) {
+    const size_t at = pos;
+    const char quote = source[pos++];
+    while (true) {
+        if (at_end() || source[pos] == '\n') fail("Unterminated terminal.", at);
+
+        char ch = source[pos++];
+        if (ch == quote) return;
+        if (ch == '\\') {
+            if (at_end()) fail("Unterminated terminal.", at);
+            ch = source[pos++];
+        }
+
+        if (ch < ' ' || ch > '~') fail("Terminals must be printable.", pos - 1);
+        seq.push_back({ static_cast<unsigned char>(ch), true });
+    }
+}
+
+void parser::impl::loader::
+apply_postfix(vector<read_symbol>& seq, size_t start, char op) {
+    const auto helper = new_helper();
+    const size_t end = seq.size();
+
+    switch (op) {
+    case '?': // piece | ""
+        add_rule(helper, seq, start, end);
+        rules.push_back({ helper, 0, 0 });
+        break;
+    case '*': // piece helper | ""
+        seq.push_back({ helper, false });
+        add_rule(helper, seq, start, end + 1);
+        rules.push_back({ helper, 0, 0 });
+        break;
+    case '+': // piece | piece helper
+        seq.push_back({ helper, false });
+        add_rule(helper, seq, start, end);
+        add_rule(helper, seq, start, end + 1);
+        break;
+    }
+
+    seq.resize(start);
+    seq.push_back({ helper, false });
+}
+
+void parser::impl::loader::
+apply() {
+    const size_t num_grams = pimpl.gram_map.size() + names.size();
+    pimpl.gram_map.reserve(num_grams);
+    pimpl.name_map.reserve(num_grams);
+    pimpl.name_map_for_norm.reserve(num_grams);
+
+    vector<grammar*> grams(names.size());
+    vector<unsigned char> existed(names.size());
+    for (std::uint32_t id = 0; id < names.size(); id++) {
+        const string name(names[id]);
+        const auto it = pimpl.gram_map.find(name);
+        existed[id] = it != pimpl.gram_map.end();
+        grams[id] = existed[id] ? &it->second.gram : &pimpl.create_family(name).gram;
+    }
+
+    // Grammars that existed before need their edits published, once each
+    vector<unsigned char> edited(names.size());
+    const auto publish_edits = [&] {
+        for (std::uint32_t id = 0; id < names.size(); id++) {
+            if (edited[id]) pimpl.publish_edit(*grams[id]);
+        }
+    };
+
+    vector<symbol> rule_symbols;
+    try {
+        for (const auto& rule : rules) {
+            rule_symbols.clear();
+            for (auto i = rule.begin; i < rule.end; i++) {
+                const auto symb = symbols[i];
+                if (symb.is_term) rule_symbols.emplace_back(static_cast<char>(symb.value));
+                else rule_symbols.emplace_back(nonterminal(*grams[symb.value]));
+            }
+
+            if (grams[rule.head]->insert(prod_rule(rule_symbols.begin(), rule_symbols.end())))
+                edited[rule.head] |= existed[rule.head];
+        }
+    } catch (...) {
+        // The rules inserted so far stay, so parses must not keep using stale snapshots
+        publish_edits();
+        throw;
+    }
+
+    publish_edits();
+}
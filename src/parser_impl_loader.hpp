@@ -0,0 +1,87 @@
+#pragma once
+
+#include "parser_impl.hpp"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <cstdint>
+
+namespace cfg_parser {
+
+/* Reads grammars written in EBNF (see parser::load_source for the format)
+in a single pass over the source. Rules are gathered with names standing
+for nonts, so forward references need no second pass, and the grammars
+are only created and filled once the whole source has been read without
+error. The caller must hold pimpl.gram_mtx. */
+class parser::impl::loader {
+
+public:
+    loader(impl& pimpl, std::string_view source) : pimpl(pimpl), source(source) {}
+
+    void load();
+
+private:
+    struct read_symbol {
+        std::uint32_t value; // The char of a terminal, or the id of a name
+        bool is_term;
+    };
+
+    struct read_rule {
+        std::uint32_t head;
+        std::uint32_t begin; // Its symbols are symbols[begin, end)
+        std::uint32_t end;
+    };
+
+    impl& pimpl;
+    std::string_view source;
+    size_t pos = 0;
+
+    std::vector<read_symbol> symbols;
+    std::vector<read_rule>   rules;
+
+    // Names by id, and where each was first seen for errors
+    std::vector<std::string_view> names;
+    std::vector<size_t>           first_seen;
+    std::vector<unsigned char>    defined;
+    std::unordered_map<std::string_view, std::uint32_t> ids;
+
+    std::deque<std::string> helper_names; // Stable, as names views them
+    size_t        num_helpers = 0;
+    std::uint32_t head = 0; // of the rule being read
+
+    [[noreturn]] void fail(const std::string& message, size_t at) const;
+
+    // __Lexing__
+
+    bool at_end() const { return pos == source.size(); }
+    char peek()   const { return at_end() ? '\0' : source[pos]; }
+
+    void skip_space();
+    static bool is_name_start(char);
+    std::string_view read_name();
+    size_t definer_length() const; // of ::= or = at pos, 0 if neither
+    bool at_rule_start();
+
+    // __Parsing__
+
+    std::uint32_t id_of(std::string_view name, size_t at);
+    std::uint32_t new_helper();
+    void add_rule(std::uint32_t rule_head, const std::vector<read_symbol>& seq, size_t beg, size_t end);
+
+    // Up to closer, or at the top level ('\0') up to the end of the rule
+    void read_alternatives(std::vector<std::vector<read_symbol>>& alts, char closer);
+    void read_sequence(std::vector<read_symbol>& seq, char closer);
+    void read_factor(std::vector<read_symbol>& seq);
+    void read_quoted(std::vector<read_symbol>& seq);
+
+    // Replaces seq[start, end) by a helper deriving it repeated as op (*, + or ?) says
+    void apply_postfix(std::vector<read_symbol>& seq, size_t start, char op);
+
+    // Creates and fills the grammars read
+    void apply();
+};
+
+}
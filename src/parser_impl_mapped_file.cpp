@@ -0,0 +1,69 @@
+#include "parser_impl_mapped_file.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define CFG_PARSER_HAS_MMAP
+#endif
+
+using std::string;
+using std::invalid_argument;
+
+using namespace cfg_parser;
+
+parser::impl::mapped_file::
+mapped_file(const string& file_name) {
+#ifdef CFG_PARSER_HAS_MMAP
+    const int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) throw invalid_argument("Couldn't open " + file_name + ".");
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw invalid_argument("Couldn't read " + file_name + ".");
+    }
+
+    num_bytes = static_cast<size_t>(info.st_size);
+    if (num_bytes == 0) { // Can't be mapped, and needn't be
+        ::close(fd);
+        return;
+    }
+
+    void* const addr = ::mmap(nullptr, num_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file open
+    if (addr == MAP_FAILED) throw invalid_argument("Couldn't map " + file_name + ".");
+
+    bytes  = static_cast<const unsigned char*>(addr);
+    mapped = true;
+#else
+    std::ifstream in(file_name, std::ios::binary | std::ios::ate);
+    if (!in) throw invalid_argument("Couldn't open " + file_name + ".");
+
+    num_bytes = static_cast<size_t>(in.tellg());
+    buffer.resize((num_bytes + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(buffer.data()), num_bytes);
+    if (!in) throw invalid_argument("Couldn't read " + file_name + ".");
+
+    bytes = reinterpret_cast<const unsigned char*>(buffer.data());
+#endif
+}
+
+parser::impl::mapped_file::
+~mapped_file() {
+#ifdef CFG_PARSER_HAS_MMAP
+    if (mapped) ::munmap(const_cast<unsigned char*>(bytes), num_bytes);
+#endif
+}
+
+void parser::impl::mapped_file::
+advise_sequential() const {
+#ifdef CFG_PARSER_HAS_MMAP
+    if (mapped) ::madvise(const_cast<unsigned char*>(bytes), num_bytes, MADV_SEQUENTIAL);
+#endif
+}
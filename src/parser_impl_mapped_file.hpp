@@ -0,0 +1,35 @@
+#pragma once
+
+#include "parser_impl.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace cfg_parser {
+
+/* A file mapped read-only into memory, or read into a buffer aligned like
+a mapping where mmap is missing. The file must not change while mapped. */
+class parser::impl::mapped_file {
+
+public:
+    explicit mapped_file(const std::string& file_name); // Throws std::invalid_argument if it can't be read
+    mapped_file(const mapped_file&) = delete;
+   ~mapped_file();
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return num_bytes; }
+    std::string_view view() const { return { reinterpret_cast<const char*>(bytes), num_bytes }; }
+
+    // Hints that it's about to be read once, front to back
+    void advise_sequential() const;
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t num_bytes = 0;
+    bool   mapped = false;
+    std::vector<std::uint64_t> buffer;
+};
+
+}
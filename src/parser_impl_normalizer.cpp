@@ -1,246 +1,433 @@
 #include "parser_impl_normalizer.hpp"
+#include "parser_impl_thread_pool.hpp"
 
 #include <unordered_set>
 #include <algorithm>
 #include <utility>
-#include <algorithm>
+#include <vector>
+#include <string>
 #include <stdexcept>
+#include <cstdint>
+#include <functional>
+#include <optional>
 
 using std::vector;
 using std::string;
 using std::unordered_set;
+using std::unordered_map;
 using std::pair;
-using std::find;
-using std::find_if;
-using std::distance;
 
 using namespace cfg_parser;
 
 parser::impl::normalizer::
-normalizer(gram_family& gram_fam) : gram_fam(gram_fam) {}
+normalizer(gram_family& gram_fam) : gram_fam(gram_fam), cache(gram_fam.pimpl->norm) {}
+
+namespace cfg_parser::internal_parser_normalizer {
+
+// Fewer tasks than that run on the calling thread, as most edits only renormalize a few nonts
+constexpr size_t min_parallel_tasks = 1024;
+constexpr size_t tasks_per_chunk    = 64;
+
+} // End of namespace internal_parser_normalizer
 
-/* Verifies whether there aren't any nonts
-reachable from gram_fam.gram are empty */
+/* Runs body on every index in [0, num_tasks), spread over the thread pool
+if there are enough of them. Each index must only write what it owns. */
 void parser::impl::normalizer::
-verify_no_reachable_empty_nonts() {
-    gram_fam.gram.dfs(
-        [&](nonterminal nont) {
-            if (nont->is_empty())
-                throw std::logic_error(gram_fam.pimpl->name_map[nont] + " is empty.");
-        }
-    );
+run_parallel(size_t num_tasks, const std::function<void(size_t)>& body) {
+    using namespace internal_parser_normalizer;
+    if (num_tasks < min_parallel_tasks) {
+        for (size_t i = 0; i < num_tasks; i++) body(i);
+        return;
+    }
+
+    const auto workers = gram_fam.pimpl->get_pool();
+    if (workers->size() < 2) {
+        for (size_t i = 0; i < num_tasks; i++) body(i);
+        return;
+    }
+
+    const size_t num_chunks = (num_tasks + tasks_per_chunk - 1) / tasks_per_chunk;
+    workers->run(num_chunks, [&](size_t chunk, size_t) {
+        const size_t end = std::min(num_tasks, (chunk + 1) * tasks_per_chunk);
+        for (size_t i = chunk * tasks_per_chunk; i < end; i++) body(i);
+    });
 }
 
-// Invokes gram_fam.gram.deep_copy to populate mut_copies
+/* Finds the nonts to renormalize: those edited since the last normalization,
+those first reached through one of them, and every nont mentioning a nont
+already found. Only nonts mentioned by stale ones are ever visited. */
 void parser::impl::normalizer::
-create_deep_copy() {
-    mut_copies = gram_fam.gram.deep_copy();
-}
+collect_stale_nonts() {
+    unordered_set<nonterminal> stale;
+    vector<nonterminal> to_visit;
+    const auto mark = [&](nonterminal nont) {
+        if (stale.insert(nont).second) to_visit.push_back(nont);
+    };
+
+    for (const auto nont : cache.dirty) mark(nont);
+    if (!cache.norm_copies.count(nonterminal(gram_fam.gram)))
+        mark(nonterminal(gram_fam.gram));
+
+    while (!to_visit.empty()) {
+        const auto nont = to_visit.back();
+        to_visit.pop_back();
+
+        const auto it = cache.mentioned_by.find(nont);
+        if (it != cache.mentioned_by.end()) {
+            for (const auto prev : it->second) mark(prev);
+        }
 
-unordered_set<grammar*> parser::impl::normalizer::
-get_grams_w_empty_rule() {
-    unordered_set<grammar*> result;
-    for (const auto& [_, ptr_copy_gram] : mut_copies) {
-        if (!ptr_copy_gram->contains("")) continue;
-        result.insert(ptr_copy_gram.get());
+        for (const auto next : nont->nonterminals()) {
+            if (!cache.norm_copies.count(next)) mark(next);
+        }
     }
 
-    return result;
+    stale_nonts.assign(stale.begin(), stale.end());
 }
 
-namespace cfg_parser::internal_parser_normalizer {
-// __Helpers for replace_reachable_empty_rules__
-
-void insert_pruned_rules(
-    grammar& copy_gram,
-    prod_rule::const_iterator beg,
-    prod_rule::const_iterator end,
-    nonterminal nont // to prune
-) {
-    const auto pos = find(beg, end, nont);
-    if (pos == end) return;
+/* Verifies whether there aren't any nonts reachable from gram_fam.gram
+that are empty. Only stale nonts can have become empty since the last
+time, though maybe while normalizing another family that can't reach them. */
+void parser::impl::normalizer::
+verify_no_reachable_empty_nonts() {
+    for (const auto nont : stale_nonts) {
+        if (nont->is_empty()) cache.empty.insert(nont);
+        else cache.empty.erase(nont);
+    }
 
-    prod_rule pruned(beg, end);
-    const auto prune_pos = pruned.begin() + distance(beg, pos);
-    pruned.erase(prune_pos);
+    for (const auto nont : cache.empty) {
+        if (nont->reachable_from(nonterminal(gram_fam.gram)))
+            throw empty_nont_error(gram_fam.pimpl->name_map[nont] + " is empty.");
+    }
+}
 
-    if (pruned.size()  != 1 ||
-        pruned.front() != nonterminal(copy_gram)
-    ) copy_gram.insert(pruned); // if rule isn't redundant
+// Creates the copy of nont if it doesn't have one yet
+grammar& parser::impl::normalizer::
+copy_of(nonterminal nont) {
+    auto& copy_ptr = cache.norm_copies[nont].gram;
+    if (!copy_ptr) {
+        copy_ptr = std::make_unique<grammar>();
+        gram_fam.pimpl->name_map_for_norm.emplace(
+            nonterminal(*copy_ptr),
+            std::to_string(++cache.num_norm_names)
+        );
+    }
 
-    insert_pruned_rules(copy_gram, pos + 1, end, nont);
-    insert_pruned_rules(copy_gram, prune_pos, pruned.end(), nont);
+    return *copy_ptr;
 }
 
-void insert_nempty_pruned_rules(
-    grammar& copy_gram,
-    prod_rule::const_iterator beg,
-    prod_rule::const_iterator end,
-    nonterminal nont // to prune
-) {
-    const auto pos = find(beg, end, nont);
-    if (pos == end) return;
+void parser::impl::normalizer::
+copy_stale_nonts() {
+    for (const auto nont : stale_nonts) {
+        auto& copy_gram = copy_of(nont);
+        copy_gram.clear();
+        stale_copies.insert(nonterminal(copy_gram));
+
+        // Released only once normalized, so the pairs its new rules share aren't made anew
+        auto& copy = cache.norm_copies.at(nont);
+        pairs_to_release.insert(pairs_to_release.end(), copy.pairs.begin(), copy.pairs.end());
+        copy.pairs.clear();
+        copy.useless = {};
+    }
 
-    prod_rule pruned(beg, end);
-    const auto prune_pos = pruned.begin() + distance(beg, pos);
-    pruned.erase(prune_pos);
+    for (const auto nont : stale_nonts) {
+        auto& mentions = cache.norm_copies.at(nont).mentions;
+        for (const auto next : mentions) cache.mentioned_by[next].erase(nont);
 
-    if (!pruned.is_empty() &&
-        (pruned.size()  != 1 || pruned.front() != nonterminal(copy_gram))
-    ) copy_gram.insert(pruned); // if rule isn't redundant
+        mentions.assign(nont->nonterminals().begin(), nont->nonterminals().end());
+        for (const auto next : mentions) cache.mentioned_by[next].insert(nont);
+    }
 
-    insert_nempty_pruned_rules(copy_gram, pos + 1, end, nont);
-    insert_nempty_pruned_rules(copy_gram, prune_pos, pruned.end(), nont);
+    // Every nont mentioned has a copy by now, stale or not, so copies are only looked up
+    run_parallel(stale_nonts.size(), [&](size_t i) {
+        const auto nont = stale_nonts[i];
+        auto& copy_gram = *cache.norm_copies.at(nont).gram;
+        for (const auto& rule : *nont) {
+            prod_rule copy_rule;
+            for (const auto& symb : rule) {
+                if (symb.is_term()) copy_rule += symb;
+                else copy_rule += nonterminal(*cache.norm_copies.at(symb.as_nont()).gram);
+            }
+
+            copy_gram.insert(std::move(copy_rule));
+        }
+    });
 }
 
-void insert_all_pruned(
-    grammar& copy_gram,
-    nonterminal nont // to prune
+namespace cfg_parser::internal_parser_normalizer {
+// __Helper for update_nullable and remove_stale_useless_rules__
+
+/* Returns those of grams with a rule whose symbols are all either
+returned as well, or not in grams and known. Every rule keeps a count of
+its symbols not found yet, and every gram found decrements the counts of
+the rules mentioning it, so each rule is looked at once per symbol. */
+template <typename pred>
+unordered_set<nonterminal> find_grams_with_rule_of(
+    const vector<grammar*>& grams,
+    const pred& known
 ) {
-    for (const auto& rule : copy_gram) {
-        insert_pruned_rules(
-            copy_gram, rule.begin(), rule.end(), nont
-        );
+    unordered_set<nonterminal> in_grams;
+    for (const auto gram : grams) in_grams.insert(nonterminal(*gram));
+
+    unordered_set<nonterminal> found;
+    vector<nonterminal> heads;  // of every rule
+    vector<size_t> num_unknown; // of every rule
+    unordered_map<nonterminal, vector<size_t>> occurrences; // of grams in rules
+    vector<nonterminal> to_visit;
+
+    for (const auto gram : grams) {
+        for (const auto& rule : *gram) {
+            size_t unknown = 0;
+            for (const auto& symb : rule) {
+                if (symb.is_nont() && in_grams.count(symb.as_nont())) {
+                    unknown++;
+                    occurrences[symb.as_nont()].push_back(heads.size());
+                } else if (!known(symb)) {
+                    unknown++;
+                }
+            }
+
+            heads.push_back(nonterminal(*gram));
+            num_unknown.push_back(unknown);
+            if (unknown == 0 && found.insert(nonterminal(*gram)).second)
+                to_visit.push_back(nonterminal(*gram));
+        }
     }
-}
 
-void insert_all_nempty_pruned(
-    grammar& copy_gram,
-    nonterminal nont // to prune
-) {
-    for (const auto& rule : copy_gram) {
-        insert_nempty_pruned_rules(
-            copy_gram, rule.begin(), rule.end(), nont
-        );
+    while (!to_visit.empty()) {
+        const auto nont = to_visit.back();
+        to_visit.pop_back();
+
+        const auto it = occurrences.find(nont);
+        if (it == occurrences.end()) continue;
+        for (const auto rule : it->second) {
+            if (--num_unknown[rule] == 0 && found.insert(heads[rule]).second)
+                to_visit.push_back(heads[rule]);
+        }
     }
+
+    return found;
 }
 
 } // End of namespace internal_parser_normalizer
 
+// Recomputes which stale grams derive the empty word, the others are up to date
 void parser::impl::normalizer::
-replace_reachable_empty_rules() {
-    unordered_set<grammar*> grams_w_empty_rule = get_grams_w_empty_rule();
-    unordered_set<const grammar*> grams_w_erased_empty_rule;
-    while (!grams_w_empty_rule.empty()) {
-        for (auto w_empty_rule : grams_w_empty_rule) {
-            w_empty_rule->erase("");
-            grams_w_erased_empty_rule.insert(w_empty_rule);
-            for (auto& [_, ptr_copy_gram] : mut_copies) {
-                auto& copy_gram = *ptr_copy_gram.get();
-                // If ptr_copy_gram has had the empty prod_rule erased,
-                // make sure the prod_rule is not reinserted when inserting pruned prod_rules
-                if (grams_w_erased_empty_rule.count(&copy_gram)) {
-                    internal_parser_normalizer::
-                    insert_all_nempty_pruned(copy_gram, nonterminal(*w_empty_rule));
-                } else {
-                    internal_parser_normalizer::
-                    insert_all_pruned(copy_gram, nonterminal(*w_empty_rule));
-                }
-            }
-        }
+update_nullable() {
+    auto& nullable = cache.nullable;
+    for (const auto gram : stale_grams) nullable.erase(nonterminal(*gram));
 
-        grams_w_empty_rule = get_grams_w_empty_rule();
-    }
-}
-
-namespace cfg_parser::internal_parser_normalizer {
-// __Helper for replace_reachable_unit_rules__
-grammar::iterator get_unit_rule(grammar& gram) {
-    return find_if(
-        gram.begin(), gram.end(),
-        [&](const prod_rule& rule) { return rule.is_unit(); }
+    const auto stale_nullable = internal_parser_normalizer::find_grams_with_rule_of(
+        stale_grams,
+        [&](const symbol& symb) { return symb.is_nont() && nullable.count(symb.as_nont()); }
     );
+
+    nullable.insert(stale_nullable.begin(), stale_nullable.end());
 }
 
+/* Replaces every rule of the stale grams by its variants leaving out
+nullable nonts. Binarized first, rules have at most 2 symbols, so each
+has at most 3 nonempty variants. */
+void parser::impl::normalizer::
+replace_stale_empty_rules() {
+    update_nullable();
+
+    const auto& nullable = cache.nullable;
+    const auto is_nullable = [&](const symbol& symb) {
+        return symb.is_nont() && nullable.count(symb.as_nont());
+    };
+
+    run_parallel(stale_grams.size(), [&](size_t i) {
+        const auto gram = stale_grams[i];
+        const vector<prod_rule> rules(gram->begin(), gram->end());
+        gram->clear();
+
+        const auto insert = [&](prod_rule&& rule) {
+            if (rule.size()  == 1 &&
+                rule.front() == nonterminal(*gram)) return; // Redundant
+            gram->insert(std::move(rule));
+        };
+
+        for (const auto& rule : rules) {
+            if (rule.is_empty()) continue;
+            insert(prod_rule(rule));
+            if (rule.size() != 2) continue;
+
+            if (is_nullable(rule.front())) insert({ rule.back()  });
+            if (is_nullable(rule.back()))  insert({ rule.front() });
+        }
+    });
 }
 
+/* Gives every stale gram the rules, but unit ones, of the grams it reaches
+through unit rules. Grams reaching one another share the same rules, so the
+unit graph is split into strongly connected components with Tarjan's
+algorithm, which completes every component after those it reaches, and each
+component gathers its rules at once. Components only wait for those they
+reach, so the ones as far from the bottom are gathered in parallel. Grams
+that aren't stale are free of unit rules already. */
 void parser::impl::normalizer::
-replace_unit_rules(nonterminal nont) {
-    auto& copy_gram = *mut_copies.at(nont);
+replace_stale_unit_rules() {
+    struct unit_node {
+        grammar* gram;
+        vector<nonterminal> targets; // of its unit rules
+        size_t index = 0;
+        size_t low   = 0;
+        bool on_stack = false;
+        size_t level = 0; // 1 + the highest of the components it reaches, but its own
+    };
+
+    unordered_map<nonterminal, unit_node> nodes;
+    for (const auto gram : stale_grams) {
+        auto& node = nodes[nonterminal(*gram)];
+        node.gram = gram;
+        for (const auto& rule : *gram) {
+            if (rule.is_unit()) node.targets.push_back(rule.front().as_nont());
+        }
+    }
 
-    /* Contains nonterminal(copy_gram) and
-    nonterminals in erased unit rules */
-    unordered_set<nonterminal> nonts_to_keep_out;
-    nonts_to_keep_out.insert(nonterminal(copy_gram));
+    // Replaces the unit rules of the component, of grams all free of them but its own
+    const auto close = [&](const vector<nonterminal>& component) {
+        const unordered_set<nonterminal> members(component.begin(), component.end());
+        vector<prod_rule> rules;
+        for (const auto nont : component) {
+            for (const auto& rule : *nont) {
+                if (!rule.is_unit()) {
+                    rules.push_back(rule);
+                    continue;
+                }
 
-    auto it = internal_parser_normalizer::get_unit_rule(copy_gram);
-    while (it != copy_gram.end()) {
-        const auto nont = it->front().as_nont();
-        nonts_to_keep_out.insert(nont);
+                const auto target = rule.front().as_nont();
+                if (members.count(target)) continue;
+                rules.insert(rules.end(), target->begin(), target->end());
+            }
+        }
 
-        for (const auto& rule : *nont) {
-            copy_gram.insert(rule);
+        for (const auto nont : component) {
+            auto& gram = *nodes.at(nont).gram;
+            for (const auto target : nodes.at(nont).targets) gram.erase({ target });
+            for (const auto& rule : rules) gram.insert(rule);
+        }
+    };
+
+    size_t num_visited = 0;
+    vector<nonterminal> stack;
+    vector<vector<vector<nonterminal>>> levels; // Components by level
+    const auto visit = [&](nonterminal nont, unit_node& node, const auto& visit) -> void {
+        node.index = node.low = ++num_visited;
+        node.on_stack = true;
+        stack.push_back(nont);
+
+        for (const auto next : node.targets) {
+            const auto it = nodes.find(next);
+            if (it == nodes.end()) continue;
+
+            auto& next_node = it->second;
+            if (!next_node.index) {
+                visit(next, next_node, visit);
+                node.low = std::min(node.low, next_node.low);
+            } else if (next_node.on_stack) {
+                node.low = std::min(node.low, next_node.index);
+            }
         }
 
-        /* Prevents insertion of redundant rule { nonterminal(copy_gram) }
-        and prevents reinsertion of unit rules already erased */
-        for (const auto nt : nonts_to_keep_out) {
-            copy_gram.erase({ nt });
+        if (node.low != node.index) return;
+
+        vector<nonterminal> component;
+        do {
+            component.push_back(stack.back());
+            stack.pop_back();
+        } while (component.back() != nont);
+
+        // Only its own members are still on the stack, the others it reaches are complete
+        size_t level = 0;
+        for (const auto member : component) {
+            for (const auto next : nodes.at(member).targets) {
+                const auto it = nodes.find(next);
+                if (it != nodes.end() && !it->second.on_stack)
+                    level = std::max(level, it->second.level + 1);
+            }
         }
 
-        it = internal_parser_normalizer::get_unit_rule(copy_gram);
+        for (const auto member : component) {
+            auto& member_node = nodes.at(member);
+            member_node.on_stack = false;
+            member_node.level = level;
+        }
+
+        if (levels.size() <= level) levels.resize(level + 1);
+        levels[level].push_back(std::move(component));
+    };
+
+    for (auto& [nont, node] : nodes) {
+        if (!node.index) visit(nont, node, visit);
+    }
+
+    for (const auto& components : levels) {
+        run_parallel(components.size(), [&](size_t i) { close(components[i]); });
     }
 }
 
+/* Erases the rules of stale grams mentioning a gram that derives no word,
+which leaves those grams without rules. Every other gram derives some word
+iff it has a rule, since it was pruned already. Nonts no longer reachable
+are left out when compiling, and their copies are reclaimed in time. */
 void parser::impl::normalizer::
-replace_reachable_unit_rules() {
-    const auto& gram = gram_fam.gram;
-    gram.dfs_bottom_up(
-        [this](nonterminal nont) { 
-            replace_unit_rules(nont);
-        } 
+remove_stale_useless_rules() {
+    const auto generating = internal_parser_normalizer::find_grams_with_rule_of(
+        stale_grams,
+        [](const symbol& symb) { return symb.is_term() || !symb.as_nont()->is_empty(); }
     );
-}
 
-nonterminal parser::impl::normalizer::
-get_singleton_nont(terminal term) {
-    const auto [it, inserted] = gram_fam.pimpl->singleton_map.emplace(
-        string(1, term.get()),
-        grammar{ { term } }
-    );
+    unordered_set<nonterminal> stale;
+    for (const auto gram : stale_grams) stale.insert(nonterminal(*gram));
 
-    const auto singleton_nont = nonterminal(it->second);
+    const auto is_useless = [&](const symbol& symb) {
+        if (symb.is_term()) return false;
+        if (stale.count(symb.as_nont())) return !generating.count(symb.as_nont());
+        return symb.as_nont()->is_empty();
+    };
 
-    if (inserted) {
-        gram_fam.pimpl->name_map_for_norm.emplace(
-            singleton_nont,
-            string(1, term.get())
-        );
-    }
+    // Counted against the copy or pair, so they're forgotten along with it
+    const auto prune = [&](grammar& gram, norm_cache::useless_count& useless) {
+        if (!generating.count(nonterminal(gram))) useless.nonts++;
 
-    return singleton_nont;
-}
-
-/* Assume singleton_map.at(term_str[:n-1]) exists,
-where term_str[:n-1] is the result of
-term_str.pop_back() and !term_str.empty() */
-nonterminal parser::impl::normalizer::
-get_singleton_nont(const string& term_str) {
-    const auto it = gram_fam.pimpl->singleton_map.find(term_str);
-    if (it != gram_fam.pimpl->singleton_map.end())
-        return nonterminal(it->second);
+        vector<prod_rule> useless_rules;
+        for (const auto& rule : gram) {
+            if (std::any_of(rule.begin(), rule.end(), is_useless))
+                useless_rules.push_back(rule);
+        }
 
-    if (term_str.size() == 1)
-        return get_singleton_nont(term_str.front());
+        for (const auto& rule : useless_rules) gram.erase(rule);
+        useless.rules += useless_rules.size();
+    };
 
-    nonterminal front_nont = get_singleton_nont(term_str.substr(0, term_str.size() - 1));
-    nonterminal  back_nont = get_singleton_nont(term_str.back());
+    vector<pair<grammar*, norm_cache::useless_count*>> to_prune;
+    for (const auto nont : stale_nonts) {
+        auto& copy = cache.norm_copies.at(nont);
+        to_prune.emplace_back(copy.gram.get(), &copy.useless);
+    }
 
-    const auto [new_it, _] = gram_fam.pimpl->singleton_map.emplace(
-        term_str, grammar{ { front_nont, back_nont } }
-    );
+    for (const auto nont : refreshed_pairs) {
+        auto& shared = cache.pair_grams.at(cache.pair_keys.at(nont));
+        to_prune.emplace_back(shared.gram.get(), &shared.useless);
+    }
 
-    gram_fam.pimpl->name_map_for_norm.emplace(
-        nonterminal(new_it->second), term_str
-    );
+    run_parallel(to_prune.size(), [&](size_t i) { prune(*to_prune[i].first, *to_prune[i].second); });
+}
 
-    return nonterminal(new_it->second);
+nonterminal parser::impl::normalizer::
+get_singleton_nont(terminal term) {
+    return get_singleton_nont(string(1, term.get()));
 }
 
-size_t parser::impl::normalizer::
-nont_pair_hash::operator()(const nont_pair& p) const {
-    return std::hash<nonterminal>()(p.first) ^
-           std::hash<nonterminal>()(p.second);
+// Acquires the singleton for gram_fam the first time it's used
+nonterminal parser::impl::normalizer::
+get_singleton_nont(const string& term_str) {
+    if (cache.singletons.insert(term_str).second)
+        return gram_fam.pimpl->acquire_singleton(term_str);
+
+    return nonterminal(gram_fam.pimpl->singleton_map.at(term_str).gram);
 }
 
 /* Returns a sequence of nonts, equivalent
@@ -274,90 +461,294 @@ nont_seq_eq_of(const prod_rule& rule) {
     return nont_seq += get_singleton_nont(term_str);
 }
 
-/* Assuming rule.size() >= 2, returns
-an equivalent rule with .size() == 2 */
+// Whether the pair spans a stale copy, so its rules as normalized are out of date
+bool parser::impl::normalizer::
+is_stale_pair(nonterminal nont) {
+    const auto key_it = cache.pair_keys.find(nont);
+    if (key_it == cache.pair_keys.end()) return false;
+
+    const auto it = pair_staleness.find(nont);
+    if (it != pair_staleness.end()) return it->second;
+
+    const auto [left, right] = key_it->second;
+    return pair_staleness[nont] = stale_copies.count(left)  || is_stale_pair(left) ||
+                                  stale_copies.count(right) || is_stale_pair(right);
+}
+
+// Gives the pair back its only rule, to normalize it anew with the stale copies
+nonterminal parser::impl::normalizer::
+use_pair(nonterminal nont) {
+    if (refreshed_pairs.count(nont) || !is_stale_pair(nont)) return nont;
+    refreshed_pairs.insert(nont);
+
+    const auto [left, right] = cache.pair_keys.at(nont);
+    auto& shared = cache.pair_grams.at({ left, right });
+    shared.gram->clear();
+    shared.gram->insert({ left, right });
+    stale_grams.push_back(shared.gram.get());
+
+    cache.nullable.erase(nont);
+    shared.useless = {};
+
+    use_pair(left);
+    use_pair(right);
+    return nont;
+}
+
+// Finds the pair { left right }, or makes it acquiring both
+nonterminal parser::impl::normalizer::
+get_pair(nonterminal left, nonterminal right) {
+    const norm_cache::nont_pair key{ left, right };
+    const auto it = cache.pair_grams.find(key);
+    if (it != cache.pair_grams.end()) return use_pair(nonterminal(*it->second.gram));
+
+    auto& shared = cache.pair_grams[key];
+    shared.gram = std::make_unique<grammar>(std::initializer_list<prod_rule>{ { left, right } });
+
+    const auto nont = nonterminal(*shared.gram);
+    cache.pair_keys.emplace(nont, key);
+    gram_fam.pimpl->name_map_for_norm.emplace(nont, std::to_string(++cache.num_norm_names));
+
+    acquire_pair(left);
+    acquire_pair(right);
+    refreshed_pairs.insert(nont);
+    stale_grams.push_back(shared.gram.get());
+    return nont;
+}
+
+void parser::impl::normalizer::
+acquire_pair(nonterminal nont) {
+    const auto key_it = cache.pair_keys.find(nont);
+    if (key_it != cache.pair_keys.end())
+        cache.pair_grams.at(key_it->second).num_refs++;
+}
+
+// Frees the pair once unused, with its name, releasing its parts in turn
+void parser::impl::normalizer::
+release_pair(nonterminal nont) {
+    const auto key_it = cache.pair_keys.find(nont);
+    if (key_it == cache.pair_keys.end()) return;
+
+    const auto key = key_it->second;
+    const auto it = cache.pair_grams.find(key);
+    if (--it->second.num_refs) return;
+
+    cache.nullable.erase(nont);
+    gram_fam.pimpl->name_map_for_norm.erase(nont);
+    cache.pair_keys.erase(key_it);
+    cache.pair_grams.erase(it);
+
+    release_pair(key.first);
+    release_pair(key.second);
+}
+
+namespace cfg_parser::internal_parser_normalizer {
+
+// Longer rules are split left to right, as finding their smallest splits is cubic
+constexpr size_t max_smallest_len = 64;
+
+} // End of namespace internal_parser_normalizer
+
+/* For every span [i, j) of nont_seq, at i * (nont_seq.size() + 1) + j,
+the point to split it at so that binarizing nont_seq adds the fewest
+pairs. Spans with a pair already count for none, and are put in made. */
+vector<size_t> parser::impl::normalizer::
+smallest_split_points(const prod_rule& nont_seq, unordered_map<size_t, nonterminal>& made) {
+    const size_t n = nont_seq.size();
+    const auto span = [n](size_t i, size_t j) { return i * (n + 1) + j; };
+    const auto made_nont = [&](size_t i, size_t j) -> std::optional<nonterminal> {
+        if (j - i == 1) return nont_seq[i].as_nont();
+        const auto it = made.find(span(i, j));
+        if (it == made.end()) return std::nullopt;
+        return it->second;
+    };
+
+    vector<size_t> split_at((n + 1) * (n + 1));
+    vector<size_t> cost((n + 1) * (n + 1)); // Pairs to add for the span
+    for (size_t len = 2; len <= n; len++) {
+        for (size_t i = 0, j = len; j <= n; i++, j++) {
+            size_t min_cost = SIZE_MAX;
+            for (size_t k = i + 1; k < j; k++) {
+                const auto left  = made_nont(i, k);
+                const auto right = made_nont(k, j);
+                if (len < n && left && right && !made.count(span(i, j))) {
+                    const auto it = cache.pair_grams.find({ *left, *right });
+                    if (it != cache.pair_grams.end())
+                        made.emplace(span(i, j), nonterminal(*it->second.gram));
+                }
+
+                if (cost[span(i, k)] + cost[span(k, j)] < min_cost) {
+                    min_cost = cost[span(i, k)] + cost[span(k, j)];
+                    split_at[span(i, j)] = k;
+                }
+            }
+
+            // The whole of nont_seq is a rule rather than a pair
+            cost[span(i, j)] = made.count(span(i, j)) ? 0 : min_cost + (len < n);
+        }
+    }
+
+    return split_at;
+}
+
+/* Assuming rule.size() >= 2, returns an equivalent rule
+with .size() == 2, acquiring the pairs it needs for copy */
 prod_rule parser::impl::normalizer::
-nont_pair_eq_of(const prod_rule& rule) {
+nont_pair_eq_of(const prod_rule& rule, norm_cache::norm_copy& copy) {
     const prod_rule nont_seq = nont_seq_eq_of(rule);
-    auto prev = nont_seq[0].as_nont();
-    for (size_t i = 1; i < nont_seq.size() - 1; i++) {
-        auto curr = nont_seq[i].as_nont();
-        const auto [it, _] = nont_pair_map.emplace(
-            nont_pair{ prev, curr },
-            std::make_unique<grammar>(
-                std::initializer_list<prod_rule>{ { prev, curr } }
-            )
-        );
+    const size_t n = nont_seq.size();
+    const auto span = [n](size_t i, size_t j) { return i * (n + 1) + j; };
+
+    unordered_map<size_t, nonterminal> made;
+    vector<size_t> split_at;
+    if (gram_fam.pimpl->bin == binarization::smallest &&
+        n <= internal_parser_normalizer::max_smallest_len) {
+        split_at = smallest_split_points(nont_seq, made);
+    }
+
+    const auto split = [&](size_t i, size_t j) {
+        return split_at.empty() ? j - 1 : split_at[span(i, j)];
+    };
+
+    const auto nont_of = [&](size_t i, size_t j, const auto& nont_of) -> nonterminal {
+        if (j - i == 1) return nont_seq[i].as_nont();
+
+        const auto it = made.find(span(i, j));
+        if (it != made.end()) return use_pair(it->second);
 
-        prev = nonterminal(*it->second.get());
+        const size_t k = split(i, j);
+        const auto left = nont_of(i, k, nont_of);
+        return get_pair(left, nont_of(k, j, nont_of));
+    };
+
+    const size_t k = split(0, n);
+    const auto left  = nont_of(0, k, nont_of);
+    const auto right = nont_of(k, n, nont_of);
+    for (const auto nont : { left, right }) {
+        if (!cache.pair_keys.count(nont)) continue;
+        acquire_pair(nont);
+        copy.pairs.push_back(nont);
     }
-    
-    return { prev, nont_seq.back() };
+
+    return { left, right };
 }
-    
+
+/* Binarizes the stale copies. Pairs are shared by the whole family, and
+those spanning a stale copy are refreshed to be normalized along with it. */
 void parser::impl::normalizer::
-convert_reachable_rules_into_pairs() {
-    for (auto& [_, ptr_copy_gram] : mut_copies) {
+convert_stale_rules_into_pairs() {
+    for (const auto nont : stale_nonts) {
+        auto& copy = cache.norm_copies.at(nont);
+        auto& copy_gram = *copy.gram;
+
         vector<pair<prod_rule, prod_rule>> rules_to_convert;
-        for (const auto& rule : *ptr_copy_gram) {
+        for (const auto& rule : copy_gram) {
             if (rule.size() < 2) continue;
             if (rule.size() == 2 &&
                 rule.front().is_nont() &&
                 rule.back().is_nont()) continue;
-            rules_to_convert.emplace_back(rule, nont_pair_eq_of(rule));
+            rules_to_convert.emplace_back(rule, nont_pair_eq_of(rule, copy));
         }
 
         for (const auto& [old_rule, new_rule] : rules_to_convert) {
-            ptr_copy_gram->erase(old_rule);
-            ptr_copy_gram->insert(new_rule);
+            copy_gram.erase(old_rule);
+            copy_gram.insert(new_rule);
         }
+
+        stale_grams.push_back(&copy_gram);
     }
 }
 
 void parser::impl::normalizer::
 set_norm_form() {
-    if (gram_fam.gram.contains("")) {
+    const auto& start_copy = copy_of(nonterminal(gram_fam.gram));
+    if (cache.nullable.count(nonterminal(start_copy))) {
         gram_fam.norm_form.insert("");
     }
 
-    for (const auto& rule : *mut_copies.at(nonterminal(gram_fam.gram)).get())
+    for (const auto& rule : start_copy)
         gram_fam.norm_form.insert(rule);
 }
 
+/* Frees the copies of nonts no longer reachable from any family normalized,
+releasing their pairs, and gives back the singletons none of the copies
+and pairs left use anymore, with their names */
 void parser::impl::normalizer::
-transfer_ownership_nonts() {
-    size_t serial = 1;
+reclaim_unreachable() {
+    auto& name_map_for_norm = gram_fam.pimpl->name_map_for_norm;
+
+    unordered_set<nonterminal> reachable;
+    for (const auto live_fam : gram_fam.pimpl->live_families) {
+        const auto start = nonterminal(live_fam->gram);
+        if (!cache.norm_copies.count(start) || reachable.count(start)) continue;
+        live_fam->gram.dfs([&](nonterminal nont) { reachable.insert(nont); });
+    }
 
-    const auto& gram_ptr = mut_copies.at(nonterminal(gram_fam.gram));
-    for (auto& [_, ptr_copy_gram] : mut_copies) {
-        if (!ptr_copy_gram->reachable_from(nonterminal(*gram_ptr)))
+    for (auto it = cache.norm_copies.begin(); it != cache.norm_copies.end();) {
+        if (reachable.count(it->first)) {
+            ++it;
             continue;
-        
-        gram_fam.pimpl->name_map_for_norm.emplace(
-            nonterminal(*ptr_copy_gram),
-            std::to_string(serial++)
-        );
+        }
 
-        gram_fam.owned_grams.emplace_back(std::move(ptr_copy_gram));
+        // Whatever mentions an unreachable nont is unreachable too
+        for (const auto next : it->second.mentions) {
+            const auto by = cache.mentioned_by.find(next);
+            if (by == cache.mentioned_by.end()) continue;
+            by->second.erase(it->first);
+            if (by->second.empty()) cache.mentioned_by.erase(by);
+        }
+
+        for (const auto pair_nont : it->second.pairs) release_pair(pair_nont);
+
+        const auto copy_nont = nonterminal(*it->second.gram);
+        cache.mentioned_by.erase(it->first);
+        cache.dirty.erase(it->first);
+        cache.empty.erase(it->first);
+        cache.nullable.erase(copy_nont);
+        name_map_for_norm.erase(copy_nont);
+        it = cache.norm_copies.erase(it);
     }
 
-    for (auto& [_, ptr_copy_gram] : nont_pair_map) {
-        gram_fam.pimpl->name_map_for_norm.emplace(
-            nonterminal(*ptr_copy_gram),
-            std::to_string(serial++)
-        );
+    unordered_set<nonterminal> owned; // Copies left and pairs
+    for (const auto& [nont, copy] : cache.norm_copies) owned.insert(nonterminal(*copy.gram));
+    for (const auto& [nont, key] : cache.pair_keys) owned.insert(nont);
 
-        gram_fam.owned_grams.emplace_back(std::move(ptr_copy_gram));
+    // Whatever else the copies left and their pairs use is a singleton
+    unordered_set<string> used_singletons;
+    for (const auto nont : owned) {
+        for (const auto& rule : *nont) {
+            for (const auto& symb : rule) {
+                if (symb.is_nont() && !owned.count(symb.as_nont()))
+                    used_singletons.insert(name_map_for_norm.at(symb.as_nont()));
+            }
+        }
+    }
+
+    for (const auto& term_str : cache.singletons) {
+        if (!used_singletons.count(term_str))
+            gram_fam.pimpl->release_singleton(term_str);
     }
+
+    cache.singletons = std::move(used_singletons);
 }
 
 void parser::impl::normalizer::
 normalize() {
+    collect_stale_nonts();
     verify_no_reachable_empty_nonts();
-    create_deep_copy();
-    replace_reachable_empty_rules();
-    replace_reachable_unit_rules();
-    convert_reachable_rules_into_pairs();
+    copy_stale_nonts();
+    convert_stale_rules_into_pairs();
+    replace_stale_empty_rules();
+    replace_stale_unit_rules();
+    remove_stale_useless_rules();
+    for (const auto nont : pairs_to_release) release_pair(nont);
     set_norm_form();
-    transfer_ownership_nonts();
-}
\ No newline at end of file
+    cache.dirty.clear();
+
+    // Amortized over renormalizing as many copies as there are
+    cache.num_renormalized += stale_nonts.size();
+    if (cache.num_renormalized >= cache.norm_copies.size()) {
+        reclaim_unreachable();
+        cache.num_renormalized = 0;
+    }
+}
@@ -3,52 +3,73 @@
 #include "parser_impl.hpp"
 
 #include <memory>
+#include <vector>
+#include <string>
 #include <unordered_set>
 #include <unordered_map>
+#include <functional>
 
 namespace cfg_parser {
 
+/* Brings gram_fam.norm_form up to date with gram_fam.gram. Copies live
+in the norm_cache every family shares, and only the nonts that can reach
+one edited since the last normalization (or that have no normalized copy
+yet) are renormalized, the copies of all the others are kept as they are. */
 class parser::impl::normalizer {
 
 public:
     normalizer(gram_family& gram_fam);
-    
+
     void normalize();
 
 private:
     gram_family& gram_fam;
-    // Mutable copies of all reachable nonts from gram_fam.gram
-    std::unordered_map<nonterminal, std::unique_ptr<grammar>> mut_copies;
-
-    using  nont_pair = std::pair<nonterminal, nonterminal>;
-    struct nont_pair_hash { size_t operator()(const nont_pair&) const; };
-    
-    std::unordered_map<
-        nont_pair,
-        std::unique_ptr<grammar>,
-        nont_pair_hash
-    > nont_pair_map;
+    norm_cache&  cache;
 
-    void verify_no_reachable_empty_nonts();
+    // Nonts of gram_fam.gram to renormalize
+    std::vector<nonterminal> stale_nonts;
+    std::unordered_set<nonterminal> stale_copies; // of those
+
+    // Their copies, and the pairs made or refreshed to binarize those
+    std::vector<grammar*> stale_grams;
 
-    void create_deep_copy();
+    // Pairs the stale copies used before being refilled, released once normalized
+    std::vector<nonterminal> pairs_to_release;
 
-    std::unordered_set<grammar*> get_grams_w_empty_rule();
-    void replace_reachable_empty_rules();
+    std::unordered_map<nonterminal, bool> pair_staleness; // Whether each pair looked at spans a stale copy
+    std::unordered_set<nonterminal> refreshed_pairs;
 
-    void replace_unit_rules(nonterminal);
-    void replace_reachable_unit_rules();
+    void run_parallel(size_t num_tasks, const std::function<void(size_t)>& body);
+
+    void collect_stale_nonts();
+    void verify_no_reachable_empty_nonts();
+
+    grammar& copy_of(nonterminal);
+    void copy_stale_nonts(); // refills their copies with their rules as written
 
     nonterminal get_singleton_nont(terminal);
     nonterminal get_singleton_nont(const std::string& term_str);
     prod_rule nont_seq_eq_of(const prod_rule&);
-    prod_rule nont_pair_eq_of(const prod_rule&);
-    void convert_reachable_rules_into_pairs();
+
+    bool is_stale_pair(nonterminal);
+    nonterminal use_pair(nonterminal); // refreshing it first if it spans a stale copy
+    nonterminal get_pair(nonterminal, nonterminal);
+    void acquire_pair(nonterminal);    // Does nothing to nonts other than pairs
+    void release_pair(nonterminal);    // Does nothing to nonts other than pairs
+
+    std::vector<size_t> smallest_split_points(const prod_rule& nont_seq, std::unordered_map<size_t, nonterminal>& made);
+    prod_rule nont_pair_eq_of(const prod_rule&, norm_cache::norm_copy&);
+    void convert_stale_rules_into_pairs();
+
+    void update_nullable();
+    void replace_stale_empty_rules();
+    void replace_stale_unit_rules();
+    void remove_stale_useless_rules();
 
     void set_norm_form(); // populates gram_fam.norm_form's rule set
-    void transfer_ownership_nonts(); // to gram_fam.owned_grams
+    void reclaim_unreachable();
 
     friend class parser_normalizer_test;
 };
 
-}
\ No newline at end of file
+}
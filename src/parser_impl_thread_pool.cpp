@@ -0,0 +1,118 @@
+#include "parser_impl_thread_pool.hpp"
+
+#include <algorithm>
+
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+
+using namespace cfg_parser;
+
+parser::impl::thread_pool::
+thread_pool(size_t num_threads) {
+    if (num_threads == 0)
+        num_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    for (size_t i = 0; i < num_threads; i++) {
+        queues.push_back(std::make_unique<task_queue>());
+    }
+
+    for (size_t i = 0; i < num_threads; i++) {
+        workers.emplace_back([this, i] { work(i); });
+    }
+}
+
+parser::impl::thread_pool::
+~thread_pool() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+
+    work_cv.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+bool parser::impl::thread_pool::
+pop(size_t worker, entry& task) {
+    auto& queue = *queues[worker];
+    lock_guard<mutex> lock(queue.mtx);
+    if (queue.tasks.empty()) return false;
+
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool parser::impl::thread_pool::
+steal(size_t worker, entry& task) {
+    for (size_t i = 1; i < queues.size(); i++) {
+        auto& victim = *queues[(worker + i) % queues.size()];
+        lock_guard<mutex> lock(victim.mtx);
+        if (victim.tasks.empty()) continue;
+
+        task = victim.tasks.back();
+        victim.tasks.pop_back();
+        return true;
+    }
+
+    return false;
+}
+
+void parser::impl::thread_pool::
+work(size_t worker) {
+    size_t seen_job = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(mtx);
+            work_cv.wait(lock, [&] { return stopping || job != seen_job; });
+            if (stopping) return;
+            seen_job = job;
+        }
+
+        /* Entries carry their own body, since a worker still draining
+        one run may pick up the first tasks of the next */
+        entry task;
+        while (pop(worker, task) || steal(worker, task)) {
+            try {
+                (*task.body)(task.task, worker);
+            } catch (...) {
+                lock_guard<mutex> lock(mtx);
+                if (!error) error = std::current_exception();
+            }
+
+            if (remaining.fetch_sub(1) == 1) {
+                lock_guard<mutex> lock(mtx);
+                done_cv.notify_all();
+            }
+        }
+    }
+}
+
+void parser::impl::thread_pool::
+run(size_t num_tasks, const task_body& body) {
+    if (num_tasks == 0) return;
+
+    lock_guard<mutex> run_lock(run_mtx);
+    {
+        lock_guard<mutex> lock(mtx);
+        error = nullptr;
+        remaining = num_tasks;
+    }
+
+    // Deals out contiguous ranges, so neighbouring tasks tend to share a worker
+    const size_t per_queue = (num_tasks + queues.size() - 1) / queues.size();
+    for (size_t i = 0; i < queues.size(); i++) {
+        lock_guard<mutex> lock(queues[i]->mtx);
+        for (size_t task = i * per_queue; task < std::min(num_tasks, (i + 1) * per_queue); task++) {
+            queues[i]->tasks.push_back({ &body, task });
+        }
+    }
+
+    unique_lock<mutex> lock(mtx);
+    job++;
+    work_cv.notify_all();
+
+    done_cv.wait(lock, [&] { return remaining == 0; });
+    if (error) std::rethrow_exception(error);
+}
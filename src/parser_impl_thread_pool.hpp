@@ -0,0 +1,65 @@
+#pragma once
+
+#include "parser_impl.hpp"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include <memory>
+
+namespace cfg_parser {
+
+/* A fixed set of workers, each with its own deque of task indices.
+Workers pop from the front of their own deque and, once it runs dry,
+steal from the back of the others' deques. */
+class parser::impl::thread_pool {
+
+public:
+    // Called with the task index and the index of the worker running it
+    using task_body = std::function<void(size_t task, size_t worker)>;
+
+    explicit thread_pool(size_t num_threads); // 0 means one per hardware thread
+    thread_pool(const thread_pool&) = delete;
+   ~thread_pool();
+
+    size_t size() const { return workers.size(); }
+
+    /* Runs body on every task in [0, num_tasks), returning once all
+    have finished. Rethrows the first exception thrown by body. */
+    void run(size_t num_tasks, const task_body& body);
+
+private:
+    struct entry {
+        const task_body* body;
+        size_t task;
+    };
+
+    struct task_queue {
+        std::mutex mtx;
+        std::deque<entry> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<task_queue>> queues; // One per worker
+
+    std::mutex run_mtx; // Lets only one run happen at a time
+    std::mutex mtx;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+
+    size_t              job = 0; // Bumped on every run
+    bool                stopping = false;
+    std::atomic<size_t> remaining{0};
+    std::exception_ptr  error;
+
+    bool pop(size_t worker, entry&);
+    bool steal(size_t worker, entry&);
+    void work(size_t worker);
+};
+
+}
@@ -0,0 +1,75 @@
+#include "parser_impl_top_down.hpp"
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+using std::string_view;
+
+using namespace cfg_parser;
+
+parser::impl::top_down::
+top_down(const compiled_grammar& gram) : tables(*gram.pimpl) {}
+
+// Spans of length len start after all spans of smaller lengths
+size_t parser::impl::top_down::
+span_index(size_t beg, size_t len) const {
+    const size_t n = text.size();
+    return (len - 1) * (n + 1) - (len - 1) * len / 2 + beg;
+}
+
+size_t parser::impl::top_down::
+block_index(code id, size_t beg, size_t len) {
+    const size_t block_size = block_lens * tables.num_nonts;
+    auto& block = blocks[beg * blocks_per_beg + (len - 1) / block_lens];
+    if (!block) {
+        memo.resize(memo.size() + block_size, result::unknown);
+        block = static_cast<std::uint32_t>(memo.size() / block_size);
+    }
+    return (block - 1) * block_size + (len - 1) % block_lens * tables.num_nonts + id;
+}
+
+bool parser::impl::top_down::
+operator()(string_view word) {
+    text = word;
+    if (text.empty()) return tables.accepts_empty;
+
+    const size_t n = text.size();
+    const size_t num_results = n * (n + 1) / 2 * tables.num_nonts;
+    if (num_results <= dense_memo_limit) {
+        memo.assign(num_results, result::unknown);
+        return derives_span<true>(0, 0, n); // The norm_form has id 0
+    }
+
+    blocks_per_beg = (n + block_lens - 1) / block_lens;
+    blocks.assign(n * blocks_per_beg, 0);
+    memo.clear();
+    return derives_span<false>(0, 0, n);
+}
+
+template <bool dense>
+bool parser::impl::top_down::
+derives_span(code id, size_t beg, size_t len) {
+    // Neither of these is worth a memo slot
+    if (len == 1) return tables.derives_term(id, text[beg]);
+    if (tables.nont_pairs[id] == tables.nont_pairs[id + 1]) return false;
+
+    // Indexed rather than referenced, as the recursion may grow the memo
+    const size_t index = dense ? span_index(beg, len) * tables.num_nonts + id
+                               : block_index(id, beg, len);
+    if (memo[index] != result::unknown)
+        return memo[index] == result::accepts;
+
+    bool accepts = false;
+    for (size_t r = tables.nont_pairs[id]; r < tables.nont_pairs[id + 1] && !accepts; r++) {
+        const code front_id = tables.pair_rules[2 * r];
+        const code  back_id = tables.pair_rules[2 * r + 1];
+        for (size_t left_len = 1; left_len < len && !accepts; left_len++) {
+            accepts = derives_span<dense>(front_id, beg, left_len) &&
+                      derives_span<dense>(back_id, beg + left_len, len - left_len);
+        }
+    }
+
+    memo[index] = accepts ? result::accepts : result::rejects;
+    return accepts;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "parser_impl.hpp"
+#include "compiled_grammar_impl.hpp"
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace cfg_parser {
+
+/* Memoized recursive descent over the normalized form of a compiled
+grammar. Every (nont, begin, length) is tried at most once, and both
+accepted and rejected spans are remembered. */
+class parser::impl::top_down {
+
+public:
+    top_down(const compiled_grammar& gram);
+
+    bool operator()(std::string_view text);
+
+private:
+    using code = compiled_grammar::impl::code;
+    enum class result : unsigned char { unknown, accepts, rejects };
+
+    const compiled_grammar::impl& tables;
+    std::string_view text;
+
+    /* Result of (id, beg, len) at memo[span_index(beg, len) * tables.num_nonts + id]
+    while all the spans of the text take at most dense_memo_limit results.
+    Longer texts would need O(n^2) of them up front, so their results are
+    instead kept in blocks of the spans with the same beg and block_lens
+    consecutive lengths, each allocated when one of its spans is first tried.
+    Block (beg, (len - 1) / block_lens) is the blocks[beg * blocks_per_beg +
+    (len - 1) / block_lens]-th of memo, or 0 if not yet allocated. */
+    static constexpr size_t dense_memo_limit = size_t(1) << 24;
+    static constexpr size_t block_lens = 64;
+
+    std::vector<result> memo;
+    std::vector<std::uint32_t> blocks;
+    size_t blocks_per_beg = 0;
+
+    size_t span_index(size_t beg, size_t len) const;
+    // Index of (id, beg, len) in memo, allocating its block if need be
+    size_t block_index(code id, size_t beg, size_t len);
+
+    template <bool dense>
+    bool derives_span(code id, size_t beg, size_t len);
+};
+
+}
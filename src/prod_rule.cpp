@@ -1,47 +1,115 @@
 #include "cfg_parser.hpp"
 
-#include <variant>
 #include <utility>
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <type_traits>
 
 using std::string;
 
 using namespace cfg_parser;
 
+static_assert(std::is_trivially_copyable_v<symbol>, "Symbols are moved around as raw memory.");
+
 prod_rule::prod_rule(const char term_seq[]) {   
     for (const char* a = term_seq; *a != '\0'; a++) {
-        symbols.push_back(terminal(*a));
+        push_back(terminal(*a));
     }
 }
 
+prod_rule::prod_rule(const prod_rule& other) {
+    reserve(other.len);
+    std::memcpy(data(), other.data(), other.len * sizeof(symbol));
+    len = other.len;
+}
+
+prod_rule::prod_rule(prod_rule&& other) noexcept {
+    *this = std::move(other);
+}
+
+prod_rule& prod_rule::operator=(const prod_rule& other) {
+    if (this == &other) return *this;
+
+    len = 0;
+    reserve(other.len);
+    std::memcpy(data(), other.data(), other.len * sizeof(symbol));
+    len = other.len;
+    return *this;
+}
+
+// Takes over the heap of other, which is left empty and inline
+prod_rule& prod_rule::operator=(prod_rule&& other) noexcept {
+    if (this == &other) return *this;
+    if (on_heap()) ::operator delete(heap);
+
+    len = other.len;
+    cap = other.cap;
+    if (other.on_heap()) heap = other.heap;
+    else std::memcpy(local, other.local, other.len * sizeof(symbol));
+
+    other.len  = 0;
+    other.cap  = inline_capacity;
+    other.heap = nullptr;
+    return *this;
+}
+
 prod_rule& prod_rule::operator=(const char term_seq[]) {
-    symbols.clear();
+    len = 0;
     for (const char* ch_ptr = term_seq; *ch_ptr != '\0'; ch_ptr++) {
-        symbols.push_back(terminal(*ch_ptr));
+        push_back(terminal(*ch_ptr));
     }
 
     return *this;
 }
 
+size_t prod_rule::checked(size_t index) const {
+    if (index >= len) throw std::out_of_range("Rule has no symbol at " + std::to_string(index) + '.');
+    return index;
+}
+
+void prod_rule::grow(size_t new_cap) {
+    if (new_cap > UINT32_MAX) throw std::length_error("Rule is too long.");
+
+    const auto new_heap = static_cast<symbol*>(::operator new(new_cap * sizeof(symbol)));
+    std::memcpy(new_heap, data(), len * sizeof(symbol));
+    if (on_heap()) ::operator delete(heap);
+
+    heap = new_heap;
+    cap  = static_cast<std::uint32_t>(new_cap);
+}
+
 bool prod_rule::contains(const symbol& target) const {
-    return std::any_of(
-        begin(), end(), 
-        [&](const symbol& symb){ return symb == target; } 
-    );
+    return std::find(begin(), end(), target) != end();
+}
+
+prod_rule::iterator prod_rule::erase(const_iterator pos) {
+    const auto mut_pos = begin() + (pos - begin());
+    std::copy(mut_pos + 1, end(), mut_pos);
+    len--;
+    return mut_pos;
 }
 
 size_t prod_rule::prune(const symbol& target) {
     const size_t old_size = size();
-    const auto new_end = std::remove(begin(), end(), target);
-    symbols.erase(new_end, symbols.end());
+    len = static_cast<std::uint32_t>(std::remove(begin(), end(), target) - begin());
     return old_size - size();
 }
 
+prod_rule& prod_rule::operator+=(const prod_rule& other) {
+    const auto other_len = other.len; // other may be *this
+    reserve(len + other_len);
+    std::memmove(data() + len, other.data(), other_len * sizeof(symbol));
+    len += other_len;
+    return *this;
+}
+
 prod_rule& prod_rule::operator+=(const char term_seq[]) {
     for (const char* ch_ptr = term_seq; *ch_ptr != '\0'; ch_ptr++) {
-        symbols.push_back(terminal(*ch_ptr));
+        push_back(terminal(*ch_ptr));
     }
 
     return *this;
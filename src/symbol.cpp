@@ -0,0 +1,59 @@
+#include "cfg_parser.hpp"
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+
+using namespace cfg_parser;
+
+std::atomic<const grammar* const*> symbol::chunks[symbol::max_chunks];
+
+namespace internal_symbol {
+
+struct id_pool {
+    mutex mtx;
+    vector<std::uint32_t> released;
+    std::uint32_t num_ids = 0; // ever handed out
+};
+
+// Never destroyed, as grammars with static storage may outlive it otherwise
+id_pool& get_id_pool() {
+    static auto* const pool = new id_pool;
+    return *pool;
+}
+
+} // End of namespace internal_symbol
+
+std::uint32_t symbol::acquire_id(const grammar& gram) {
+    constexpr size_t chunk_size = size_t(1) << chunk_bits;
+
+    auto& pool = internal_symbol::get_id_pool();
+    lock_guard<mutex> lock(pool.mtx);
+
+    std::uint32_t id;
+    if (!pool.released.empty()) {
+        id = pool.released.back();
+        pool.released.pop_back();
+    } else {
+        if (pool.num_ids == max_chunks * chunk_size) throw std::length_error("Too many grammars.");
+        id = pool.num_ids++;
+        if (!(id % chunk_size)) {
+            chunks[id >> chunk_bits].store(new const grammar*[chunk_size], std::memory_order_release);
+        }
+    }
+
+    // Written before any symbol holding the id can be, so readers see it
+    const auto chunk = const_cast<const grammar**>(chunks[id >> chunk_bits].load(std::memory_order_relaxed));
+    chunk[id & (chunk_size - 1)] = &gram;
+    return id;
+}
+
+void symbol::release_id(std::uint32_t id) {
+    auto& pool = internal_symbol::get_id_pool();
+    lock_guard<mutex> lock(pool.mtx);
+    pool.released.push_back(id);
+}
@@ -0,0 +1,168 @@
+#include "cfg_parser.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iterator>
+
+using std::string;
+using std::shared_ptr;
+
+using namespace cfg_parser;
+
+TEST(compiled_grammar_test, parses_with_every_engine) {
+    parser pser;
+    pser.create("Dyck3", { "" });
+    const auto dyck3 = pser.get_nont("Dyck3");
+    pser.insert("Dyck3", '(' + dyck3 + ')');
+    pser.insert("Dyck3", '[' + dyck3 + ']');
+    pser.insert("Dyck3", '{' + dyck3 + '}');
+    pser.insert("Dyck3", dyck3 + dyck3);
+
+    const auto compiled = pser.compile("Dyck3");
+    ASSERT_GT(compiled->num_nonterminals(), 0);
+    ASSERT_GT(compiled->num_rules(), 0);
+
+    for (const auto engine : { parse_engine::top_down, parse_engine::cyk, parse_engine::earley }) {
+        ASSERT_TRUE(compiled->parse("", engine));
+        ASSERT_TRUE(compiled->parse("[({})]", engine));
+        ASSERT_TRUE(compiled->parse("{[[]]}()(({})){}", engine));
+        ASSERT_FALSE(compiled->parse("(", engine));
+        ASSERT_FALSE(compiled->parse("{[[]}()(({})){}", engine));
+    }
+}
+
+TEST(compiled_grammar_test, compiles_once) {
+    parser pser;
+    pser.create("A", { "a" });
+    ASSERT_EQ(pser.compile("A"), pser.compile("A"));
+    ASSERT_ANY_THROW(pser.compile("B"));
+}
+
+TEST(compiled_grammar_test, outlives_its_parser) {
+    shared_ptr<const compiled_grammar> compiled;
+    {
+        parser pser;
+        pser.create("S", { "a" });
+        const auto s = pser.get_nont("S");
+        pser.insert("S", s + s);
+        compiled = pser.compile("S");
+    }
+
+    ASSERT_TRUE(compiled->parse("aaaa"));
+    ASSERT_FALSE(compiled->parse("aaba"));
+    ASSERT_FALSE(compiled->parse(""));
+}
+
+TEST(compiled_grammar_test, keeps_its_version_across_edits) {
+    parser pser;
+    pser.create("A", { "a" });
+    pser.create("B", { "b" });
+    const auto b = pser.get_nont("B");
+    pser.insert("A", { b });
+
+    const auto before = pser.compile("A");
+    pser.insert("B", "c");
+    const auto after = pser.compile("A");
+
+    ASSERT_NE(before, after);
+    ASSERT_LT(before->version(), after->version());
+    ASSERT_FALSE(before->parse("c"));
+    ASSERT_TRUE(after->parse("c"));
+
+    ASSERT_FALSE(pser.insert("B", "c"));
+    ASSERT_EQ(pser.compile("A"), after);
+}
+
+TEST(compiled_grammar_test, prunes_nonterminals_deriving_no_word) {
+    parser pser;
+    pser.create("A");
+    pser.create("S", { "a" });
+    const auto a = pser.get_nont("A");
+    pser.insert("A", a + 'a');
+    pser.insert("S", a + 'b');
+
+    // A -> A a derives no word, so neither does S -> A b
+    const auto pruned = pser.compile("S");
+    ASSERT_EQ(pruned->num_pruned_nonterminals(), 1);
+    ASSERT_EQ(pruned->num_pruned_rules(), 2);
+    ASSERT_EQ(pruned->num_rules(), 1);
+    ASSERT_TRUE (pruned->parse("a"));
+    ASSERT_FALSE(pruned->parse("ab"));
+
+    pser.insert("A", "a");
+    const auto unpruned = pser.compile("S");
+    ASSERT_EQ(unpruned->num_pruned_nonterminals(), 0);
+    ASSERT_EQ(unpruned->num_pruned_rules(), 0);
+    ASSERT_TRUE(unpruned->parse("aab"));
+}
+
+TEST(compiled_grammar_test, merges_equivalent_nonterminals) {
+    parser pser;
+    pser.create("A", { "a" });
+    pser.create("B", { "a" });
+    const auto a = pser.get_nont("A");
+    const auto b = pser.get_nont("B");
+    pser.insert("A", a + b);
+    pser.insert("B", b + a);
+
+    // A -> A B | a and B -> B A | a both derive a+
+    pser.create("S", { a + b, b + a });
+    const auto compiled = pser.compile("S");
+    ASSERT_GT(compiled->num_merged_nonterminals(), 0);
+    ASSERT_EQ(compiled->num_nonterminals(), 2);
+
+    for (const auto engine : { parse_engine::top_down, parse_engine::cyk, parse_engine::earley }) {
+        ASSERT_TRUE (compiled->parse("aa", engine));
+        ASSERT_TRUE (compiled->parse("aaaaa", engine));
+        ASSERT_FALSE(compiled->parse("a", engine));
+        ASSERT_FALSE(compiled->parse("aab", engine));
+    }
+}
+
+TEST(compiled_grammar_test, loads_what_it_saved) {
+    const string file_name = testing::TempDir() + "dyck2.cfgg";
+    shared_ptr<const compiled_grammar> saved;
+    {
+        parser pser;
+        pser.create("Dyck2", { "" });
+        const auto dyck2 = pser.get_nont("Dyck2");
+        pser.insert("Dyck2", '(' + dyck2 + ')');
+        pser.insert("Dyck2", '[' + dyck2 + ']');
+        pser.insert("Dyck2", dyck2 + dyck2);
+        saved = pser.compile("Dyck2");
+        saved->save(file_name);
+    }
+
+    const auto loaded = compiled_grammar::load(file_name);
+    ASSERT_EQ(loaded->name(), "Dyck2");
+    ASSERT_EQ(loaded->version(), saved->version());
+    ASSERT_EQ(loaded->num_nonterminals(), saved->num_nonterminals());
+    ASSERT_EQ(loaded->num_rules(), saved->num_rules());
+    ASSERT_EQ(loaded->num_merged_nonterminals(), saved->num_merged_nonterminals());
+
+    for (const auto engine : { parse_engine::top_down, parse_engine::cyk, parse_engine::earley }) {
+        ASSERT_TRUE (loaded->parse("", engine));
+        ASSERT_TRUE (loaded->parse("[()]()[[]]", engine));
+        ASSERT_FALSE(loaded->parse("[(])", engine));
+        ASSERT_FALSE(loaded->parse("((", engine));
+    }
+}
+
+TEST(compiled_grammar_test, refuses_to_load_other_files) {
+    const string file_name = testing::TempDir() + "not_a_grammar.cfgg";
+    ASSERT_ANY_THROW(compiled_grammar::load(file_name + ".missing"));
+
+    std::ofstream(file_name) << "S -> a S b | ab";
+    ASSERT_THROW(compiled_grammar::load(file_name), std::invalid_argument);
+
+    // Cut short, so its tables run past the end of the file
+    parser pser;
+    pser.create("S", { "ab" });
+    pser.compile("S")->save(file_name);
+    std::ifstream in(file_name, std::ios::binary);
+    const string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::ofstream(file_name, std::ios::binary | std::ios::trunc) << bytes.substr(0, bytes.size() - 8);
+    ASSERT_THROW(compiled_grammar::load(file_name), std::invalid_argument);
+}
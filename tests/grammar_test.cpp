@@ -4,6 +4,7 @@
 #include <unordered_set>
 #include <vector>
 #include <utility>
+#include <algorithm>
 
 using std::vector;
 using std::unordered_set;
@@ -59,7 +60,7 @@ TEST_F(grammar_test, grammar_cant_have_redundant_rule) {
     ASSERT_ANY_THROW(gram.insert({ nonterminal(gram) }));
 }
 
-TEST_F(grammar_test, copied_grammar_own_its_rules) {
+TEST_F(grammar_test, copied_grammar_shares_its_rules) {
     grammar gram1 = { empty_rule, rule1, rule2 };
     unordered_set<const prod_rule*> addresses;
     addresses.insert(&empty_rule);
@@ -69,6 +70,7 @@ TEST_F(grammar_test, copied_grammar_own_its_rules) {
         ASSERT_TRUE(addresses.find(&rule) == addresses.end());
     }
 
+    // Equal rules are stored once, however many grammars hold them
     grammar gram2 = gram1;
     addresses.clear();
     for (const auto& rule : gram1) {
@@ -76,14 +78,29 @@ TEST_F(grammar_test, copied_grammar_own_its_rules) {
     }
 
     for (const auto& rule : gram2) {
-        ASSERT_TRUE(addresses.find(&rule) == addresses.end());
+        ASSERT_TRUE(addresses.find(&rule) != addresses.end());
     }
 
     gram2 = {};
     gram2 = gram1;
-        for (const auto& rule : gram2) {
-        ASSERT_TRUE(addresses.find(&rule) == addresses.end());
+    for (const auto& rule : gram2) {
+        ASSERT_TRUE(addresses.find(&rule) != addresses.end());
     }
+
+    const grammar gram3 = { rule1 };
+    ASSERT_EQ(&*gram3.begin(), &*std::find(gram1.begin(), gram1.end(), rule1));
+
+    // Yet each copy is still edited on its own
+    ASSERT_TRUE(gram2.erase(rule1));
+    ASSERT_TRUE(gram2.insert(prod_rule("xyz")));
+    ASSERT_EQ(gram1.size(), 3);
+    ASSERT_TRUE(gram1.contains(rule1));
+    ASSERT_FALSE(gram1.contains(prod_rule("xyz")));
+    ASSERT_FALSE(gram1.erase(prod_rule("xyz")));
+    ASSERT_TRUE(gram2.contains(prod_rule("xyz")));
+    ASSERT_FALSE(gram2.insert(prod_rule("xyz")));
+    ASSERT_EQ(gram2.size(), 3);
+    ASSERT_EQ(*std::find(gram1.begin(), gram1.end(), rule1), rule1);
 }
 
 TEST_F(grammar_test, inserts_and_erases_rule) {
@@ -113,6 +130,40 @@ TEST_F(grammar_test, inserts_and_erases_rule) {
     ASSERT_TRUE(gram.contains(rule1));
 }
 
+TEST_F(grammar_test, keeps_rules_through_churn) {
+    // Rules of mostly one or two symbols, many sharing their hash's low bits
+    const auto rule_of = [](size_t i) {
+        prod_rule rule(1, char('a' + i % 26));
+        for (size_t n = i / 26; n; n /= 26) rule += char('a' + n % 26);
+        return rule;
+    };
+
+    grammar gram;
+    unordered_set<prod_rule> expected;
+    for (size_t round = 0; round < 4; round++) {
+        for (size_t i = 0; i < 3000; i++) {
+            const auto rule = rule_of((i * 7919 + round) % 5000);
+            ASSERT_EQ(gram.insert(rule), expected.insert(rule).second);
+        }
+
+        for (size_t i = 0; i < 3000; i++) {
+            const auto rule = rule_of((i * 104729 + round) % 5000);
+            ASSERT_EQ(gram.erase(rule), expected.erase(rule) > 0);
+        }
+
+        ASSERT_EQ(gram.size(), expected.size());
+        ASSERT_EQ(unordered_set<prod_rule>(gram.begin(), gram.end()), expected);
+        for (size_t i = 0; i < 5000; i++) {
+            ASSERT_EQ(gram.contains(rule_of(i)), expected.count(rule_of(i)) > 0) << i;
+        }
+    }
+
+    gram.clear();
+    ASSERT_TRUE(gram.is_empty());
+    ASSERT_FALSE(gram.contains(rule_of(0)));
+    ASSERT_TRUE(gram.insert(rule_of(0)));
+}
+
 TEST_F(grammar_test, getters_return_correct_sets) {
     grammar gram = { empty_rule, rule1 };
     ASSERT_EQ(gram.terminals(),    unordered_set<terminal>{ term });
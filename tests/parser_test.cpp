@@ -7,6 +7,12 @@
 #include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <cstdint>
+#include <cstdio>
 
 using std::string;
 using std::vector;
@@ -208,4 +214,714 @@ TEST(parser_test, arithmetic_expression) {
     ASSERT_FALSE(pser.parse("Expr", "(x + yz) + y"));
     ASSERT_FALSE(pser.parse("Expr", "x(yz)"));
     ASSERT_FALSE(pser.parse("Expr", "((x + yz))xz"));
-}
\ No newline at end of file
+}
+
+TEST(parser_test, cyk_agrees_with_top_down) {
+    parser pser;
+    pser.create("Pal", { "", "a", "b" });
+    const auto pal = pser.get_nont("Pal");
+    pser.insert("Pal", 'a' + pal + 'a');
+    pser.insert("Pal", 'b' + pal + 'b');
+
+    const vector<string> texts = {
+        "", "a", "ab", "aba", "abba", "abab", "baab", "aabbaa", "aabbab", "babbbab"
+    };
+
+    for (const auto& text : texts) {
+        ASSERT_EQ(
+            pser.parse("Pal", text, parse_engine::cyk),
+            pser.parse("Pal", text, parse_engine::top_down)
+        ) << text;
+    }
+}
+
+TEST(parser_test, cyk_rejects_long_ambiguous_input) {
+    parser pser;
+    pser.create("S", { "a" });
+    const auto s = pser.get_nont("S");
+    pser.insert("S", s + s);
+
+    ASSERT_TRUE(pser.parse("S", string(200, 'a'), parse_engine::cyk));
+    ASSERT_FALSE(pser.parse("S", string(199, 'a') + 'b', parse_engine::cyk));
+    ASSERT_FALSE(pser.parse("S", "", parse_engine::cyk));
+}
+
+TEST(parser_test, earley_agrees_with_cyk) {
+    parser pser;
+    pser.create("Dyck3", { "" });
+    const auto dyck3 = pser.get_nont("Dyck3");
+    pser.insert("Dyck3", '(' + dyck3 + ')');
+    pser.insert("Dyck3", '[' + dyck3 + ']');
+    pser.insert("Dyck3", dyck3 + dyck3);
+
+    const vector<string> texts = {
+        "", "()", "[]()", "([])", "(([]))[]", "(", "([)]", "(()", "[]]", "x"
+    };
+
+    for (const auto& text : texts) {
+        ASSERT_EQ(
+            pser.parse("Dyck3", text, parse_engine::earley),
+            pser.parse("Dyck3", text, parse_engine::cyk)
+        ) << text;
+    }
+}
+
+TEST(parser_test, earley_handles_optional_pieces) {
+    parser pser;
+    pser.create("Opt", { "", "-" });
+    const auto opt = pser.get_nont("Opt");
+    pser.create("Digits", { "0", "1" });
+    const auto digits = pser.get_nont("Digits");
+    pser.insert("Digits", digits + digits);
+    pser.create("Num", { opt + digits + opt + opt });
+    pser.create("Loop", { "x" });
+    const auto loop = pser.get_nont("Loop");
+    pser.insert("Loop", { loop, opt });
+
+    ASSERT_TRUE(pser.parse("Num", "0", parse_engine::earley));
+    ASSERT_TRUE(pser.parse("Num", "-101", parse_engine::earley));
+    ASSERT_TRUE(pser.parse("Num", "-101--", parse_engine::earley));
+    ASSERT_FALSE(pser.parse("Num", "", parse_engine::earley));
+    ASSERT_FALSE(pser.parse("Num", "---0", parse_engine::earley));
+    ASSERT_FALSE(pser.parse("Num", "1-0", parse_engine::earley));
+
+    ASSERT_TRUE(pser.parse("Loop", "x--", parse_engine::earley));
+    ASSERT_FALSE(pser.parse("Loop", "-x", parse_engine::earley));
+}
+
+TEST(parser_test, top_down_rejects_long_ambiguous_input) {
+    parser pser;
+    pser.create("S", { "a" });
+    const auto s = pser.get_nont("S");
+    pser.insert("S", s + s);
+
+    ASSERT_TRUE(pser.parse("S", string(100, 'a'), parse_engine::top_down));
+    ASSERT_FALSE(pser.parse("S", string(99, 'a') + 'b', parse_engine::top_down));
+    ASSERT_FALSE(pser.parse("S", 'b' + string(99, 'a'), parse_engine::top_down));
+}
+
+TEST(parser_test, top_down_memoizes_only_spans_tried) {
+    parser pser;
+    pser.create("S", { "b" });
+    pser.insert("S", terminal('a') + pser.get_nont("S"));
+
+    // Every span of the text at once would be some hundred MBs
+    ASSERT_TRUE(pser.parse("S", string(10000, 'a') + 'b', parse_engine::top_down));
+    ASSERT_FALSE(pser.parse("S", string(10000, 'a'), parse_engine::top_down));
+}
+
+TEST(parser_test, parse_batch_agrees_with_parse) {
+    parser pser;
+    pser.create("Dyck3", { "" });
+    const auto dyck3 = pser.get_nont("Dyck3");
+    pser.insert("Dyck3", '(' + dyck3 + ')');
+    pser.insert("Dyck3", '[' + dyck3 + ']');
+    pser.insert("Dyck3", dyck3 + dyck3);
+
+    vector<string> texts;
+    for (size_t i = 0; i < 300; i++) {
+        string text = string(i % 7, '(') + string(i % 7, ')') + (i % 3 ? "[]" : "[");
+        texts.push_back(i % 5 ? text : string(text.rbegin(), text.rend()));
+    }
+
+    const vector<std::string_view> words(texts.begin(), texts.end());
+
+    for (const size_t num_threads : { 1, 4 }) {
+        pser.set_num_threads(num_threads);
+        for (const auto engine : { parse_engine::top_down, parse_engine::cyk, parse_engine::earley }) {
+            const auto results = pser.parse_batch("Dyck3", words, engine);
+            ASSERT_EQ(results.size(), texts.size());
+            for (size_t i = 0; i < texts.size(); i++) {
+                ASSERT_EQ(results[i], pser.parse("Dyck3", texts[i], engine)) << texts[i];
+            }
+        }
+    }
+
+    ASSERT_TRUE(pser.parse_batch("Dyck3", {}).empty());
+    ASSERT_ANY_THROW(pser.parse_batch("Dyck4", words));
+}
+
+TEST(parser_test, parses_concurrently) {
+    parser pser;
+    pser.create("Pal", { "", "a", "b" });
+    const auto pal = pser.get_nont("Pal");
+    pser.insert("Pal", 'a' + pal + 'a');
+    pser.insert("Pal", 'b' + pal + 'b');
+
+    const vector<string> texts = { "abba", "abab", "aabbaa", "babbbab", "ba" };
+    const vector<bool> expected = { true, false, true, true, false };
+
+    std::atomic<size_t> num_wrong{0};
+    vector<std::thread> threads;
+    for (size_t t = 0; t < 8; t++) {
+        threads.emplace_back(
+            [&, t] {
+                const auto engine = t % 3 == 0 ? parse_engine::earley : parse_engine::cyk;
+                for (size_t i = 0; i < 50; i++) {
+                    const size_t k = (t + i) % texts.size();
+                    if (pser.parse("Pal", texts[k], engine) != expected[k]) num_wrong++;
+                }
+            }
+        );
+    }
+
+    for (auto& thread : threads) thread.join();
+    ASSERT_EQ(num_wrong, 0);
+}
+
+TEST(parser_test, resizes_the_pool_while_batching) {
+    parser pser;
+    pser.create("Pal", { "", "a", "b" });
+    const auto pal = pser.get_nont("Pal");
+    pser.insert("Pal", 'a' + pal + 'a');
+    pser.insert("Pal", 'b' + pal + 'b');
+
+    vector<string> texts;
+    for (size_t i = 0; i < 500; i++) texts.push_back(i % 2 ? "abba" : "abab");
+    const vector<std::string_view> words(texts.begin(), texts.end());
+
+    std::atomic<bool>   done{false};
+    std::atomic<size_t> num_wrong{0};
+    std::thread batcher(
+        [&] {
+            while (!done) {
+                const auto results = pser.parse_batch("Pal", words);
+                for (size_t i = 0; i < results.size(); i++) {
+                    if (results[i] != (i % 2 == 1)) num_wrong++;
+                }
+            }
+        }
+    );
+
+    for (size_t i = 0; i < 50; i++) pser.set_num_threads(1 + i % 4);
+
+    done = true;
+    batcher.join();
+    ASSERT_EQ(num_wrong, 0);
+}
+
+TEST(parser_test, edits_while_parsing) {
+    parser pser;
+    pser.create("Pal", { "", "a", "b" });
+    const auto pal = pser.get_nont("Pal");
+    pser.insert("Pal", 'a' + pal + 'a');
+    pser.insert("Pal", 'b' + pal + 'b');
+    ASSERT_FALSE(pser.parse("Pal", "cc"));
+
+    std::atomic<bool>   done{false};
+    std::atomic<size_t> num_wrong{0};
+    vector<std::thread> readers;
+    for (size_t t = 0; t < 4; t++) {
+        readers.emplace_back(
+            [&, t] {
+                const auto engine = t % 2 ? parse_engine::earley : parse_engine::cyk;
+                while (!done) {
+                    // Unaffected by the edits, whichever snapshot the parse lands on
+                    if (!pser.parse("Pal", "abba", engine)) num_wrong++;
+                    if ( pser.parse("Pal", "abab", engine)) num_wrong++;
+                    pser.parse("Pal", "acca", engine);
+                }
+            }
+        );
+    }
+
+    // Not ASSERT, which would return with the readers still running
+    for (size_t i = 0; i < 20; i++) {
+        pser.insert("Pal", 'c' + pal + 'c');
+        EXPECT_TRUE(pser.parse("Pal", "acca"));
+        pser.erase("Pal", 'c' + pal + 'c');
+        EXPECT_FALSE(pser.parse("Pal", "acca"));
+    }
+
+    done = true;
+    for (auto& reader : readers) reader.join();
+    ASSERT_EQ(num_wrong, 0);
+}
+
+TEST(parser_test, renormalizes_after_edits) {
+    parser pser;
+    pser.create("S");
+    pser.create("A", { "a" });
+    pser.create("B", { "c" });
+    const auto a = pser.get_nont("A");
+    const auto b = pser.get_nont("B");
+    pser.insert("S", a + 'b');
+
+    ASSERT_TRUE (pser.parse("S", "ab"));
+    ASSERT_FALSE(pser.parse("S", "b"));
+
+    pser.insert("A", "");
+    ASSERT_TRUE(pser.parse("S", "ab"));
+    ASSERT_TRUE(pser.parse("S", "b"));
+
+    pser.erase("A", "a");
+    ASSERT_FALSE(pser.parse("S", "ab"));
+    ASSERT_TRUE (pser.parse("S", "b"));
+
+    pser.insert("A", { b });
+    ASSERT_TRUE(pser.parse("S", "cb"));
+
+    pser.insert("S", { a });
+    ASSERT_TRUE(pser.parse("S", ""));
+    ASSERT_TRUE(pser.parse("S", "c"));
+}
+
+TEST(parser_test, renormalizes_like_a_fresh_parser) {
+    // Builds S -> A S B | A, A -> a | B B, B -> b | A and, if extra, B -> empty
+    const auto build = [](parser& pser, bool extra) {
+        pser.create("S");
+        pser.create("A", { "a" });
+        pser.create("B", { "b" });
+        const auto s = pser.get_nont("S");
+        const auto a = pser.get_nont("A");
+        const auto b = pser.get_nont("B");
+        pser.insert("S", a + s + b);
+        pser.insert("S", { a });
+        pser.insert("A", b + b);
+        pser.insert("B", { a });
+        if (extra) pser.insert("B", "");
+    };
+
+    parser edited;
+    build(edited, false);
+    edited.compile("S");
+    edited.insert("B", "");
+
+    parser fresh;
+    build(fresh, true);
+
+    vector<string> words = { "" };
+    for (size_t len = 1; len <= 5; len++) {
+        for (size_t bits = 0; bits < size_t(1) << len; bits++) {
+            string word;
+            for (size_t i = 0; i < len; i++) word += bits >> i & 1 ? 'b' : 'a';
+            words.push_back(word);
+        }
+    }
+
+    for (const auto& word : words) {
+        ASSERT_EQ(edited.parse("S", word), fresh.parse("S", word)) << word;
+        ASSERT_EQ(edited.parse("S", word), edited.parse("S", word, parse_engine::earley)) << word;
+    }
+}
+
+TEST(parser_test, keeps_shared_pieces_through_churn) {
+    parser pser;
+    pser.create("A", { "a" });
+    pser.create("B", { "b" });
+    const auto a = pser.get_nont("A");
+    const auto b = pser.get_nont("B");
+    pser.insert("A", a + "xyz");
+    pser.insert("B", b + "xyz");
+    pser.compile("A");
+    pser.compile("B");
+
+    // A drops and regains its pieces, while B keeps using the same "xyz"
+    for (size_t i = 0; i < 100; i++) {
+        const char ch = 'c' + i % 20;
+        pser.insert("A", a + ch + "xy" + ch);
+        pser.erase("A", a + "xyz");
+        ASSERT_TRUE(pser.parse("B", "bxyzxyz"));
+        ASSERT_TRUE(pser.parse("A", string("a") + ch + "xy" + ch));
+
+        pser.insert("A", a + "xyz");
+        pser.erase("A", a + ch + "xy" + ch);
+        ASSERT_TRUE (pser.parse("A", "axyz"));
+        ASSERT_FALSE(pser.parse("A", string("a") + ch + "xy" + ch));
+    }
+}
+
+TEST(parser_test, normalizes_long_rules_of_optional_pieces) {
+    parser pser;
+    pser.create("A", { "", "a" });
+    pser.create("B", { "", "b" });
+    const auto a = pser.get_nont("A");
+    const auto b = pser.get_nont("B");
+
+    // 2^32 ways to leave pieces out, were they all written down
+    prod_rule rule;
+    for (size_t i = 0; i < 16; i++) rule += a + b;
+    pser.create("S", { rule });
+
+    ASSERT_TRUE (pser.parse("S", ""));
+    ASSERT_TRUE (pser.parse("S", "abba"));
+    ASSERT_TRUE (pser.parse("S", string(16, 'a') + "b"));
+    ASSERT_FALSE(pser.parse("S", string(16, 'a') + "bb"));
+    ASSERT_FALSE(pser.parse("S", string(17, 'a')));
+
+    for (size_t len = 1; len <= 10; len++) {
+        for (size_t bits = 0; bits < size_t(1) << len; bits += 7) {
+            string word;
+            for (size_t i = 0; i < len; i++) word += bits >> i & 1 ? 'b' : 'a';
+            ASSERT_EQ(pser.parse("S", word), pser.parse("S", word, parse_engine::earley)) << word;
+        }
+    }
+}
+
+TEST(parser_test, replaces_cycles_of_unit_rules) {
+    parser pser;
+    pser.create("A", { "a" });
+    pser.create("B", { "b" });
+    pser.create("C", { "c" });
+    pser.create("D", { "d" });
+    const auto a = pser.get_nont("A");
+    const auto b = pser.get_nont("B");
+    const auto c = pser.get_nont("C");
+    const auto d = pser.get_nont("D");
+
+    // A -> B -> C -> A, which also reaches D -> C
+    pser.insert("A", { b });
+    pser.insert("B", { c });
+    pser.insert("C", { a });
+    pser.insert("C", a + d);
+    pser.insert("D", { c });
+
+    for (const auto& word : { "a", "b", "c", "d", "ad", "cd", "add", "dd", "da" }) {
+        for (const auto& start : { "A", "B", "C", "D" }) {
+            ASSERT_EQ(pser.parse(start, word), pser.parse(start, word, parse_engine::earley)) << start << ' ' << word;
+        }
+    }
+
+    ASSERT_TRUE (pser.parse("A", "adcb"));
+    ASSERT_FALSE(pser.parse("A", "d"));
+    ASSERT_TRUE (pser.parse("D", "d"));
+}
+
+TEST(parser_test, shares_pairs_across_rules) {
+    // S -> A B C D | E B C D | F B C D, where the last 3 nonts are shared
+    const auto build = [](parser& pser) {
+        pser.create("S");
+        for (const auto name : { "A", "B", "C", "D", "E", "F" }) {
+            pser.create(name, { string(1, name[0] - 'A' + 'a') });
+        }
+
+        const auto b = pser.get_nont("B");
+        const auto c = pser.get_nont("C");
+        const auto d = pser.get_nont("D");
+        for (const auto name : { "A", "E", "F" }) {
+            pser.insert("S", pser.get_nont(name) + b + c + d);
+        }
+    };
+
+    parser prefix_sharing;
+    build(prefix_sharing);
+
+    parser smallest;
+    smallest.set_binarization(binarization::smallest);
+    build(smallest);
+
+    ASSERT_LT(smallest.compile("S")->num_nonterminals(), prefix_sharing.compile("S")->num_nonterminals());
+    for (const auto& word : { "abcd", "ebcd", "fbcd", "abc", "bcd", "abdc", "aebcd" }) {
+        ASSERT_EQ(smallest.parse("S", word), prefix_sharing.parse("S", word)) << word;
+        ASSERT_EQ(smallest.parse("S", word), smallest.parse("S", word, parse_engine::earley)) << word;
+    }
+}
+
+TEST(parser_test, renormalizes_pairs_shared_across_nonterminals) {
+    // S -> A B C | T, T -> A B D, and once edited B -> b | empty, A -> a | b
+    const auto build = [](parser& pser, bool edited) {
+        pser.create("S");
+        pser.create("T");
+        pser.create("A", { "a" });
+        pser.create("B", { "b" });
+        pser.create("C", { "c" });
+        pser.create("D", { "d" });
+        const auto a = pser.get_nont("A");
+        const auto b = pser.get_nont("B");
+        pser.insert("S", a + b + pser.get_nont("C"));
+        pser.insert("S", { pser.get_nont("T") });
+        pser.insert("T", a + b + pser.get_nont("D"));
+        if (edited) {
+            pser.insert("B", "");
+            pser.insert("A", "b");
+        }
+    };
+
+    vector<string> words = { "" };
+    for (size_t len = 1; len <= 4; len++) {
+        for (size_t code = 0; code < size_t(1) << 2 * len; code++) {
+            string word;
+            for (size_t i = 0; i < len; i++) word += "abcd"[code >> 2 * i & 3];
+            words.push_back(word);
+        }
+    }
+
+    for (const auto bin : { binarization::prefix_sharing, binarization::smallest }) {
+        parser edited;
+        edited.set_binarization(bin);
+        build(edited, false);
+        edited.compile("S");
+        edited.compile("T");
+        edited.insert("B", "");
+        edited.insert("A", "b");
+
+        parser fresh;
+        fresh.set_binarization(bin);
+        build(fresh, true);
+
+        for (const auto& word : words) {
+            ASSERT_EQ(edited.parse("S", word), fresh.parse("S", word)) << word;
+            ASSERT_EQ(edited.parse("T", word), fresh.parse("T", word)) << word;
+            ASSERT_EQ(edited.parse("S", word), edited.parse("S", word, parse_engine::earley)) << word;
+        }
+    }
+}
+
+TEST(parser_test, shares_normalized_pieces_across_grammars) {
+    parser pser;
+    pser.create("Expr", { "x" });
+    const auto expr = pser.get_nont("Expr");
+    pser.insert("Expr", expr + '+' + expr);
+
+    // Stmt i -> c Expr ; for the i-th letter c, all reaching the same Expr
+    for (char ch = 'a'; ch <= 'z'; ch++) {
+        pser.create(string("Stmt") + ch, { ch + expr + ';' });
+        ASSERT_TRUE(pser.parse(string("Stmt") + ch, ch + string("x+x;")));
+    }
+
+    pser.insert("Expr", "y");
+    for (char ch = 'a'; ch <= 'z'; ch++) {
+        ASSERT_TRUE (pser.parse(string("Stmt") + ch, ch + string("x+y;")));
+        ASSERT_FALSE(pser.parse(string("Stmt") + ch, ch + string("y+;")));
+    }
+
+    // Hole is emptied while only Stmta can reach it, then renormalized along with Stmtb
+    pser.create("Hole", { "h" });
+    pser.insert("Stmta", { pser.get_nont("Hole") });
+    ASSERT_TRUE(pser.parse("Stmta", "h"));
+    pser.erase("Hole", "h");
+    pser.insert("Stmtb", "b");
+    ASSERT_TRUE(pser.parse("Stmtb", "b"));
+    ASSERT_ANY_THROW(pser.parse("Stmta", "ax;"));
+
+    pser.insert("Hole", "h");
+    ASSERT_TRUE(pser.parse("Stmta", "h"));
+}
+
+TEST(parser_test, normalizes_in_parallel_like_serially) {
+    // Enough nonts that normalizing them spreads over the pool, with empty, unit and useless rules
+    const auto build = [](parser& pser) {
+        constexpr size_t num_chains = 200;
+        constexpr size_t chain_size = 8;
+        pser.create("Start", {});
+        for (size_t chain = 0; chain < num_chains; chain++) {
+            const auto prefix = std::to_string(chain) + '_';
+            for (size_t i = chain_size; i-- > 0;) {
+                const auto name = "Link" + prefix + std::to_string(i);
+                const auto dead_name = "Dead" + prefix + std::to_string(i);
+                pser.create(name, { "" });
+                pser.create(dead_name, { "d" });
+                const auto dead = pser.get_nont(dead_name);
+                pser.insert(dead_name, 'd' + dead);
+                pser.erase(dead_name, "d");
+
+                const auto link = pser.get_nont(name);
+                if (i + 1 == chain_size) {
+                    pser.insert(name, string(1, 'c' + chain % 3));
+                    continue;
+                }
+
+                const auto next_name = "Link" + prefix + std::to_string(i + 1);
+                const auto next = pser.get_nont(next_name);
+                pser.insert(name, 'a' + next + 'b');
+                pser.insert(name, dead + link);
+                if (i % 3 != 0) continue;
+
+                // A short cycle of unit rules
+                pser.insert(name, { next });
+                pser.insert(next_name, { link });
+            }
+
+            pser.insert("Start", { pser.get_nont("Link" + prefix + '0') });
+        }
+    };
+
+    parser serial;
+    serial.set_num_threads(1);
+    build(serial);
+
+    parser parallel;
+    parallel.set_num_threads(4);
+    build(parallel);
+
+    for (const string word : { "", "c", "e", "ab", "aeb", "aacbb", "aabb", "abab", "aab", "ba", "d", "acbd" }) {
+        const bool expected = serial.parse("Start", word, parse_engine::earley);
+        ASSERT_EQ(serial.parse("Start", word), expected) << word;
+        ASSERT_EQ(parallel.parse("Start", word), expected) << word;
+        ASSERT_EQ(parallel.parse("Start", word, parse_engine::top_down), expected) << word;
+    }
+
+    const auto serial_form = serial.compile("Start");
+    const auto parallel_form = parallel.compile("Start");
+    ASSERT_EQ(parallel_form->num_nonterminals(), serial_form->num_nonterminals());
+    ASSERT_EQ(parallel_form->num_rules(), serial_form->num_rules());
+    ASSERT_EQ(parallel_form->num_pruned_rules(), serial_form->num_pruned_rules());
+}
+
+TEST(parser_test, compiles_in_the_background) {
+    parser pser;
+    pser.create("Pal", { "", "a", "b" });
+    const auto pal = pser.get_nont("Pal");
+    pser.insert("Pal", 'a' + pal + 'a');
+    pser.insert("Pal", 'b' + pal + 'b');
+
+    auto warm = pser.compile_async("Pal");
+    const auto before = warm.get();
+    ASSERT_TRUE(before->parse("abba"));
+    ASSERT_EQ(pser.compile("Pal"), before); // Nothing changed since
+    ASSERT_ANY_THROW(pser.compile_async("Pam"));
+
+    pser.set_background_compile(true);
+    pser.insert("Pal", 'c' + pal + 'c');
+    pser.parse("Pal", "cabac"); // Either snapshot, whichever is out
+
+    // compile waits for the edit, while the snapshot held before stays as it was
+    const auto after = pser.compile("Pal");
+    ASSERT_TRUE (after->parse("cabac"));
+    ASSERT_FALSE(before->parse("cabac"));
+    ASSERT_TRUE (pser.parse("Pal", "cabac"));
+    ASSERT_TRUE (pser.compile_async("Pal").get()->parse("cc"));
+
+    // Edits keep the Earley snapshots up to date too
+    ASSERT_TRUE(pser.parse("Pal", "cc", parse_engine::earley));
+    pser.erase("Pal", 'c' + pal + 'c');
+    ASSERT_FALSE(pser.compile("Pal")->parse("cc"));
+    pser.compile_async("Pal").get(); // Queued after the edit's own job
+    ASSERT_FALSE(pser.parse("Pal", "cc", parse_engine::earley));
+
+    // Without a normal form, the future carries the error
+    pser.create("Hole");
+    pser.insert("Pal", { pser.get_nont("Hole") });
+    ASSERT_THROW(pser.compile_async("Pal").get(), std::logic_error);
+    pser.insert("Hole", "h");
+    ASSERT_TRUE(pser.compile_async("Pal").get()->parse("h"));
+}
+
+TEST(parser_test, loads_grammars_written_in_ebnf) {
+    parser pser;
+    pser.load_source(R"(
+        # Forward references, groups and repetitions
+        Expr ::= Term { ('+' | '-') Term } ;
+        Term ::= Atom+
+        Atom ::= 'x' | "y" | '(' Expr ')' | <Call>
+        <Call> = "f(" [ Expr { ',' Expr } ] ')' ;
+        Quote ::= '\'' Atom? '\''
+    )");
+
+    for (const string word : { "x", "x+y", "xy-(x)", "f()", "f(x,y+x)x", "(f(f(y)))" }) {
+        ASSERT_TRUE(pser.parse("Expr", word)) << word;
+        ASSERT_TRUE(pser.parse("Expr", word, parse_engine::earley)) << word;
+    }
+
+    for (const string word : { "", "+x", "x+", "f(,)", "(x", "f(x,)" }) {
+        ASSERT_FALSE(pser.parse("Expr", word)) << word;
+        ASSERT_FALSE(pser.parse("Expr", word, parse_engine::earley)) << word;
+    }
+
+    ASSERT_TRUE (pser.parse("Quote", "''"));
+    ASSERT_TRUE (pser.parse("Quote", "'f(x)'"));
+    ASSERT_FALSE(pser.parse("Quote", "'xx'"));
+    ASSERT_TRUE (pser.parse("Call", "f(x)"));
+
+    // Rules for grammars that exist already are added to them
+    pser.load_source("Atom ::= 'z' ; Stmt ::= Expr ';'");
+    ASSERT_TRUE(pser.parse("Expr", "z+x"));
+    ASSERT_TRUE(pser.parse("Stmt", "xz;"));
+}
+
+TEST(parser_test, loads_nothing_from_a_malformed_source) {
+    parser pser;
+    pser.create("A", { "a" });
+    pser.compile("A");
+
+    const auto throws_at_line = [&](const string& source, const string& line) {
+        try {
+            pser.load_source(source);
+        } catch (const std::invalid_argument& error) {
+            return string(error.what()).rfind("Line " + line + ':', 0) == 0;
+        }
+
+        return false;
+    };
+
+    ASSERT_TRUE(throws_at_line("B ::= A C ;\nC ::= 'c' | ;\nD ::= E", "3"));
+    ASSERT_TRUE(throws_at_line("B ::= 'b\nC ::= 'c'", "1"));
+    ASSERT_TRUE(throws_at_line("B ::= A\n\nC ::= ( 'c' | A", "3"));
+    ASSERT_TRUE(throws_at_line("B ::= A ]", "1"));
+    ASSERT_TRUE(throws_at_line("B 'b'", "1"));
+    ASSERT_TRUE(throws_at_line("B ::= <> ;", "1"));
+    ASSERT_TRUE(throws_at_line("A ::= 'b'\n    | A ;", "2"));
+    ASSERT_TRUE(throws_at_line("A ::= 'b' | ( A ) ;", "1"));
+    ASSERT_ANY_THROW(pser.load("no_such_grammar.ebnf"));
+
+    // None of the grammars read before the error were created or edited
+    ASSERT_ANY_THROW(pser.get_nont("B"));
+    ASSERT_ANY_THROW(pser.get_nont("C"));
+    for (const auto engine : { parse_engine::top_down, parse_engine::cyk, parse_engine::earley }) {
+        ASSERT_TRUE(pser.parse("A", "a", engine));
+        ASSERT_FALSE(pser.parse("A", "b", engine));
+    }
+
+    // Unlike a repetition of nothing, which derives just the empty word
+    pser.load_source("E ::= 'e' { } ;");
+    ASSERT_TRUE(pser.parse("E", "e"));
+}
+
+TEST(parser_test, parses_files_line_by_line) {
+    parser pser;
+    pser.create("Dyck2", { "" });
+    const auto dyck2 = pser.get_nont("Dyck2");
+    pser.insert("Dyck2", '(' + dyck2 + ')');
+    pser.insert("Dyck2", dyck2 + dyck2);
+    pser.set_num_threads(4);
+
+    // Enough lines for more than one batch, some ending in \r\n and the last in nothing
+    vector<string> lines;
+    string source;
+    for (size_t i = 0; i < 70000; i++) {
+        lines.push_back(string(i % 5, '(') + string(i % 4, ')'));
+        source += lines.back() + (i % 3 ? "\n" : "\r\n");
+    }
+    source.pop_back();
+
+    const string file_name = testing::TempDir() + "dyck2_lines.txt";
+    std::ofstream(file_name, std::ios::binary) << source;
+
+    string expected;
+    for (const auto& line : lines) {
+        expected += "Dyck2" + string(pser.parse("Dyck2", line) ? " accepts " : " rejects ") + line + '\n';
+    }
+
+    for (const auto engine : { parse_engine::cyk, parse_engine::earley }) {
+        string written;
+        pser.parse_file("Dyck2", file_name, [&](std::string_view chunk) { written += chunk; }, engine);
+        ASSERT_EQ(written, expected);
+    }
+
+    const string result_file_name = testing::TempDir() + "dyck2_lines.bits";
+    ASSERT_EQ(pser.parse_file_to("Dyck2", file_name, result_file_name), lines.size());
+
+    std::ifstream in(result_file_name, std::ios::binary);
+    const string result((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(result.size(), 8 + (lines.size() + 7) / 8);
+
+    std::uint64_t num_lines = 0;
+    for (size_t i = 0; i < 8; i++) num_lines |= std::uint64_t(static_cast<unsigned char>(result[i])) << 8 * i;
+    ASSERT_EQ(num_lines, lines.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        const bool accepted = static_cast<unsigned char>(result[8 + i / 8]) >> i % 8 & 1;
+        ASSERT_EQ(accepted, pser.parse("Dyck2", lines[i])) << i;
+    }
+
+    // An empty file has no lines, and a trailing line break ends the last one
+    std::ofstream(file_name, std::ios::binary | std::ios::trunc) << "";
+    ASSERT_EQ(pser.parse_file_to("Dyck2", file_name, result_file_name), 0);
+    std::ofstream(file_name, std::ios::binary | std::ios::trunc) << "()\n(\n";
+    ASSERT_EQ(pser.parse_file_to("Dyck2", file_name, result_file_name), 2);
+
+    ASSERT_THROW(pser.parse_file("Dyck2", testing::TempDir() + "no_such_file.txt"), std::invalid_argument);
+    ASSERT_ANY_THROW(pser.parse_file("Dyck3", file_name));
+
+    std::remove(file_name.c_str());
+    std::remove(result_file_name.c_str());
+}
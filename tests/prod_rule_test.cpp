@@ -2,6 +2,7 @@
 
 #include <gtest/gtest.h>
 #include <string>
+#include <vector>
 
 using std::string;
 
@@ -410,3 +411,33 @@ TEST_F(prod_rule_test, prunes_given_cond) {
     ASSERT_EQ(rule.at(2), nont2);
     ASSERT_EQ(rule.at(3), nont_symb);
 }
+
+TEST_F(prod_rule_test, grows_past_inline_storage) {
+    static_assert(sizeof(prod_rule) <= sizeof(std::vector<symbol>));
+
+    prod_rule rule;
+    for (size_t i = 0; i < 20; i++) {
+        rule += (i % 2 ? symbol(nont1) : symbol(char('a' + i)));
+        ASSERT_EQ(rule.size(), i + 1);
+        for (size_t j = 0; j <= i; j++) {
+            ASSERT_EQ(rule.at(j), (j % 2 ? symbol(nont1) : symbol(char('a' + j))));
+        }
+    }
+
+    // Appending a rule to itself, and shrinking back below the inline capacity
+    prod_rule twice = rule;
+    twice += twice;
+    ASSERT_EQ(twice.size(), 40);
+    ASSERT_EQ(prod_rule(twice.begin() + 20, twice.end()), rule);
+
+    ASSERT_EQ(rule.prune(nont1), 10);
+    while (rule.size() > 2) rule.erase(rule.begin() + 1);
+    ASSERT_EQ(rule, prod_rule("as"));
+
+    // Moving an inline rule copies its symbols, and leaves the source empty
+    prod_rule short_rule = { nont1, term1 };
+    const prod_rule moved = std::move(short_rule);
+    ASSERT_EQ(moved, prod_rule({ nont1, term1 }));
+    ASSERT_TRUE(short_rule.is_empty());
+    ASSERT_ANY_THROW(moved.at(2));
+}
@@ -1,6 +1,8 @@
 #include "cfg_parser.hpp"
 
 #include <gtest/gtest.h>
+#include <vector>
+#include <memory>
 
 using namespace cfg_parser;
 
@@ -48,3 +50,26 @@ TEST_F(symbol_test, symbols_get_alt) {
     ASSERT_ANY_THROW(symbol(term).as_nont());
     ASSERT_ANY_THROW(symbol(nont).as_term());
 }
+
+TEST_F(symbol_test, symbols_take_32_bits) {
+    static_assert(sizeof(symbol) == 4);
+
+    // Ids of grammars gone are reused, yet every symbol still finds its own grammar
+    for (size_t round = 0; round < 3; round++) {
+        std::vector<std::unique_ptr<grammar>> grams;
+        std::vector<symbol> symbs;
+        for (size_t i = 0; i < 1000; i++) {
+            grams.push_back(std::make_unique<grammar>());
+            symbs.emplace_back(nonterminal(*grams.back()));
+        }
+
+        for (size_t i = 0; i < grams.size(); i++) {
+            ASSERT_EQ(symbs[i].as_nont(), nonterminal(*grams[i]));
+            ASSERT_NE(symbs[i], nont_symb);
+            ASSERT_NE(symbs[i], symbol('a'));
+        }
+    }
+
+    ASSERT_EQ(nont_symb.as_nont(), nont);
+    ASSERT_EQ(std::hash<symbol>()(symbol('a')), std::hash<symbol>()(term_symb));
+}